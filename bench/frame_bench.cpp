@@ -0,0 +1,207 @@
+// Headless frame-loop benchmark.
+// Runs the whole Window/ImGui/Application stack on a hidden (software when
+// available) GL context, replays a scripted session on synthetic images and
+// prints frame-time percentiles of Window::run_one_frame as JSON.
+//
+//   polaroid_bench [--images N] [--frames N] [--size WxH] [--out file.json]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include "window.h"
+#include "application.h"
+#include "allocator.h"
+#include "jobs.h"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+
+struct Options
+{
+	int images = 24;
+	int frames = 240; // per phase
+	cv::Size size = cv::Size(4000, 3000);
+	std::string out;
+};
+
+struct Phase
+{
+	std::string name;
+	std::vector<double> times; // milliseconds
+};
+
+static bool ParseOptions(int argc, char **argv, Options &options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--images") && hasValue)
+			options.images = std::max(2, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "--frames") && hasValue)
+			options.frames = std::max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "--size") && hasValue && sscanf(argv[++i], "%dx%d", &options.size.width, &options.size.height) == 2)
+			continue;
+		else if (!strcmp(argv[i], "--out") && hasValue)
+			options.out = argv[++i];
+		else
+			return false;
+	}
+	return true;
+}
+
+// Gradients and a grid, half of them portrait, so compose and thumbnails do real work.
+static std::vector<std::string> MakeImages(const Options &options, const std::filesystem::path &folder)
+{
+	std::filesystem::create_directories(folder);
+	std::vector<std::string> paths;
+	for (int i = 0; i < options.images; i++)
+	{
+		cv::Size size = i % 2 ? cv::Size(options.size.height, options.size.width) : options.size;
+		cv::Mat image(size, CV_8UC3);
+		for (int y = 0; y < size.height; y++)
+		{
+			cv::Vec3b *row = image.ptr<cv::Vec3b>(y);
+			for (int x = 0; x < size.width; x++)
+				row[x] = cv::Vec3b((uchar)(x * 255 / size.width), (uchar)(y * 255 / size.height), (uchar)(i * 37));
+		}
+		for (int x = 0; x < size.width; x += 64)
+			cv::line(image, cv::Point(x, 0), cv::Point(x, size.height - 1), cv::Scalar(255, 255, 255), 2);
+		for (int y = 0; y < size.height; y += 64)
+			cv::line(image, cv::Point(0, y), cv::Point(size.width - 1, y), cv::Scalar(255, 255, 255), 2);
+
+		std::string path = (folder / ("bench_" + std::to_string(i) + ".jpg")).string();
+		cv::imwrite(path, image);
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+static double Percentile(std::vector<double> times, double p)
+{
+	if (times.empty())
+		return 0.0;
+	std::sort(times.begin(), times.end());
+	size_t index = std::min(times.size() - 1, (size_t)(p * (times.size() - 1) + 0.5));
+	return times[index];
+}
+
+static void PrintStats(FILE *file, const std::vector<double> &times)
+{
+	double total = 0.0;
+	for (double t : times)
+		total += t;
+	double mean = times.empty() ? 0.0 : total / times.size();
+	double max = times.empty() ? 0.0 : *std::max_element(times.begin(), times.end());
+	fprintf(file, "{\"frames\": %zu, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}",
+			times.size(), mean, Percentile(times, 0.50), Percentile(times, 0.90), Percentile(times, 0.95), Percentile(times, 0.99), max);
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		fprintf(stderr, "usage: %s [--images N] [--frames N] [--size WxH] [--out file.json]\n", argv[0]);
+		return 1;
+	}
+
+	MatPool::Install();
+	JobSystem::Get().Start();
+	std::filesystem::path folder = std::filesystem::temp_directory_path() / "polaroid-bench";
+	std::vector<std::string> paths = MakeImages(options, folder);
+
+	Window window("Polaroid bench", 1280, 720, true, true);
+	{
+		Application app;
+		auto frame = [&]() { app.Frame(); };
+		auto timed = [&]()
+		{
+			auto start = std::chrono::steady_clock::now();
+			window.run_one_frame(frame);
+			glFinish(); // count the GPU work of the frame, not only its submission
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		};
+
+		// thumbnails, first decode and first compose are not part of the measure
+		app.OpenFiles(paths);
+		auto warmup = std::chrono::steady_clock::now();
+		while (!app.IsIdle() && std::chrono::steady_clock::now() - warmup < std::chrono::seconds(60))
+			window.run_one_frame(frame);
+		bool warmedUp = app.IsIdle();
+
+		FrameSettings base = app.GetFrameSettings();
+		std::vector<Phase> phases;
+		std::vector<std::pair<std::string, std::function<void(int)>>> script = {
+			{"idle", [&](int) {}},
+			{"select", [&](int i)
+			 {
+				 // a new image every few frames, like stepping through a shoot
+				 if (i % 8 == 0)
+					 app.SelectImage((i / 8 + 1) % app.GetImageCount());
+			 }},
+			{"drag_size", [&](int i)
+			 {
+				 FrameSettings settings = base;
+				 float t = (float)(i % 120) / 120.0f;
+				 settings.width = base.width + 4.0f * t;
+				 settings.height = base.height + 2.0f * t;
+				 app.SetFrameSettings(settings);
+			 }},
+			{"drag_offset", [&](int i)
+			 {
+				 FrameSettings settings = base;
+				 float t = (float)(i % 120) / 120.0f;
+				 settings.borderOffset = base.borderOffset + 0.5f * t;
+				 settings.bottomOffset = base.bottomOffset + 1.0f * t;
+				 app.SetFrameSettings(settings);
+			 }},
+			{"scroll_strip", [&](int i) { app.SetStripScroll((float)(i * 24 % 4000)); }},
+		};
+
+		for (auto &[name, step] : script)
+		{
+			Phase phase{name, {}};
+			for (int i = 0; i < options.frames; i++)
+			{
+				step(i);
+				phase.times.push_back(timed());
+			}
+			app.SetFrameSettings(base);
+			phases.push_back(std::move(phase));
+		}
+
+		FILE *file = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+		if (!file)
+		{
+			fprintf(stderr, "cannot write %s\n", options.out.c_str());
+			std::error_code error;
+			std::filesystem::remove_all(folder, error);
+			return 1;
+		}
+		std::vector<double> all;
+		MatPool::Stats pool = MatPool::Get().GetStats();
+		fprintf(file, "{\n  \"images\": %d,\n  \"image_size\": [%d, %d],\n  \"warmed_up\": %s,\n  \"phases\": {\n",
+				options.images, options.size.width, options.size.height, warmedUp ? "true" : "false");
+		for (size_t i = 0; i < phases.size(); i++)
+		{
+			fprintf(file, "    \"%s\": ", phases[i].name.c_str());
+			PrintStats(file, phases[i].times);
+			fprintf(file, i + 1 < phases.size() ? ",\n" : "\n");
+			all.insert(all.end(), phases[i].times.begin(), phases[i].times.end());
+		}
+		fprintf(file, "  },\n  \"overall\": ");
+		PrintStats(file, all);
+		fprintf(file, ",\n  \"mat_pool\": {\"reuse_rate\": %.3f, \"system_allocs\": %zu, \"peak_bytes_in_use\": %zu}\n}\n",
+				pool.GetReuseRate(), pool.systemAllocs, pool.peakBytesInUse);
+		if (file != stdout)
+			fclose(file);
+	}
+
+	std::error_code error;
+	std::filesystem::remove_all(folder, error);
+	return 0;
+}
@@ -0,0 +1,244 @@
+#include "allocator.h"
+#include <bit>
+
+static const int kThreadSlotsPerClass = 2;
+static const size_t kThreadCacheBytes = 64u << 20;
+
+// Classes step by a quarter of the power of two below the size, at most 25% is wasted.
+static int ClassIndex(size_t bytes)
+{
+	int power = (int)std::bit_width(bytes) - 1;
+	size_t quarter = (size_t)1 << (power - 2);
+	size_t steps = (bytes - ((size_t)1 << power) + quarter - 1) / quarter;
+	if (steps == 4)
+	{
+		power++;
+		steps = 0;
+	}
+	return (power - 16) * 4 + (int)steps;
+}
+
+static size_t ClassBytes(int index)
+{
+	int power = index / 4 + 16;
+	return ((size_t)1 << power) + (size_t)(index % 4) * ((size_t)1 << (power - 2));
+}
+
+static bool IsPooled(size_t bytes)
+{
+	return bytes >= MatPool::kMinPooledBytes && bytes <= MatPool::kMaxPooledBytes;
+}
+
+// Trivially destructible, still valid while thread_local objects are being destroyed.
+static thread_local bool sThreadExiting = false;
+
+// Buffers kept by one thread, handed to the shared pool when the thread exits.
+struct MatPoolThreadCache
+{
+	std::vector<void *> free[MatPool::kClassCount];
+	size_t bytes = 0;
+
+	~MatPoolThreadCache()
+	{
+		Flush();
+		sThreadExiting = true;
+	}
+
+	void Flush()
+	{
+		const MatPool &pool = MatPool::Get();
+		for (int index = 0; index < MatPool::kClassCount; index++)
+		{
+			size_t size = ClassBytes(index);
+			for (void *buffer : free[index])
+			{
+				pool.mBytesCached -= size;
+				if (!pool.Store(index, buffer, size))
+					cv::fastFree(buffer);
+			}
+			free[index].clear();
+		}
+		bytes = 0;
+	}
+};
+
+static thread_local MatPoolThreadCache sThreadCache;
+
+// nullptr once the thread is exiting, Mats released by other thread_local destructors go to the shared pool
+static MatPoolThreadCache *GetThreadCache()
+{
+	return sThreadExiting ? nullptr : &sThreadCache;
+}
+
+MatPool &MatPool::Get()
+{
+	static MatPool *pool = new MatPool();
+	return *pool;
+}
+
+void MatPool::Install()
+{
+	cv::Mat::setDefaultAllocator(&Get());
+}
+
+void *MatPool::Acquire(size_t bytes) const
+{
+	mBytesInUse += bytes;
+	size_t inUse = mBytesInUse.load();
+	size_t peak = mPeakBytesInUse.load();
+	while (inUse > peak && !mPeakBytesInUse.compare_exchange_weak(peak, inUse))
+	{
+	}
+
+	if (!IsPooled(bytes))
+	{
+		mSystemAllocs++;
+		return cv::fastMalloc(bytes);
+	}
+
+	mRequests++;
+	int index = ClassIndex(bytes);
+	size_t size = ClassBytes(index);
+	MatPoolThreadCache *cache = GetThreadCache();
+	if (cache && !cache->free[index].empty())
+	{
+		void *buffer = cache->free[index].back();
+		cache->free[index].pop_back();
+		cache->bytes -= size;
+		mBytesCached -= size;
+		mReused++;
+		return buffer;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mFree[index].empty())
+		{
+			void *buffer = mFree[index].back();
+			mFree[index].pop_back();
+			mPoolBytes -= size;
+			mBytesCached -= size;
+			mReused++;
+			return buffer;
+		}
+	}
+
+	mSystemAllocs++;
+	return cv::fastMalloc(size);
+}
+
+bool MatPool::Store(int index, void *buffer, size_t bytes) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mPoolBytes + bytes > mBudget)
+		return false;
+	mFree[index].push_back(buffer);
+	mPoolBytes += bytes;
+	mBytesCached += bytes;
+	return true;
+}
+
+void MatPool::Recycle(void *buffer, size_t bytes) const
+{
+	mBytesInUse -= bytes;
+	if (!IsPooled(bytes))
+	{
+		cv::fastFree(buffer);
+		return;
+	}
+
+	int index = ClassIndex(bytes);
+	size_t size = ClassBytes(index);
+	MatPoolThreadCache *cache = GetThreadCache();
+	if (cache && cache->free[index].size() < (size_t)kThreadSlotsPerClass && cache->bytes + size <= kThreadCacheBytes)
+	{
+		cache->free[index].push_back(buffer);
+		cache->bytes += size;
+		mBytesCached += size;
+		return;
+	}
+	if (!Store(index, buffer, size))
+		cv::fastFree(buffer);
+}
+
+// Same contract as OpenCV's StdMatAllocator, only the buffer comes from the pool.
+cv::UMatData *MatPool::allocate(int dims, const int *sizes, int type, void *data0, size_t *step, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+	size_t total = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; i--)
+	{
+		if (step)
+		{
+			if (data0 && step[i] != CV_AUTOSTEP)
+			{
+				CV_Assert(total <= step[i]);
+				total = step[i];
+			}
+			else
+			{
+				step[i] = total;
+			}
+		}
+		total *= sizes[i];
+	}
+
+	uchar *data = data0 ? (uchar *)data0 : (uchar *)Acquire(total);
+	cv::UMatData *u = new cv::UMatData(this);
+	u->data = u->origdata = data;
+	u->size = total;
+	if (data0)
+		u->flags |= cv::UMatData::USER_ALLOCATED;
+	return u;
+}
+
+bool MatPool::allocate(cv::UMatData *u, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+	return u != nullptr;
+}
+
+void MatPool::deallocate(cv::UMatData *u) const
+{
+	if (!u)
+		return;
+	CV_Assert(u->urefcount == 0);
+	CV_Assert(u->refcount == 0);
+	if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+	{
+		Recycle(u->origdata, u->size);
+		u->origdata = 0;
+	}
+	delete u;
+}
+
+void MatPool::Trim() const
+{
+	if (MatPoolThreadCache *cache = GetThreadCache())
+		cache->Flush();
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (int index = 0; index < kClassCount; index++)
+	{
+		for (void *buffer : mFree[index])
+			cv::fastFree(buffer);
+		mBytesCached -= mFree[index].size() * ClassBytes(index);
+		mFree[index].clear();
+	}
+	mPoolBytes = 0;
+}
+
+void MatPool::SetBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mBudget = bytes;
+}
+
+MatPool::Stats MatPool::GetStats() const
+{
+	Stats stats;
+	stats.requests = mRequests;
+	stats.reused = mReused;
+	stats.systemAllocs = mSystemAllocs;
+	stats.bytesInUse = mBytesInUse;
+	stats.peakBytesInUse = mPeakBytesInUse;
+	stats.bytesCached = mBytesCached;
+	return stats;
+}
@@ -0,0 +1,69 @@
+#ifndef _ALLOCATOR_H_
+#define _ALLOCATOR_H_
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "opencv2/core.hpp"
+
+// cv::Mat allocator recycling large buffers by size class, so that decoding,
+// composing and exporting frame after frame reuses the same memory instead of
+// going back to the system for every multi-megabyte temporary.
+// Each thread keeps a few buffers of its own in front of a shared pool; the
+// shared pool is bounded by a byte budget and anything beyond it is freed.
+// Buffers below kMinPooledBytes go straight to cv::fastMalloc.
+class MatPool : public cv::MatAllocator
+{
+public:
+	static const size_t kMinPooledBytes = 64u << 10;
+	static const size_t kMaxPooledBytes = 1u << 30;
+
+	struct Stats
+	{
+		size_t requests;	 // pooled size allocations
+		size_t reused;		 // served from a cache
+		size_t systemAllocs; // went to the system
+		size_t bytesInUse;
+		size_t peakBytesInUse;
+		size_t bytesCached;	 // idle in the thread caches and the shared pool
+
+		double GetReuseRate() const { return requests ? reused / (double)requests : 0.0; }
+	};
+
+	// Never destroyed, Mats may outlive main and still hand their buffer back.
+	static MatPool &Get();
+	// Make the pool the default allocator of every cv::Mat created afterwards.
+	static void Install();
+
+	cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+	bool allocate(cv::UMatData *data, cv::AccessFlag accessflags, cv::UMatUsageFlags usageFlags) const override;
+	void deallocate(cv::UMatData *data) const override;
+
+	// Free the idle buffers of the shared pool and of the calling thread.
+	void Trim() const;
+	void SetBudget(size_t bytes);
+	Stats GetStats() const;
+
+private:
+	friend struct MatPoolThreadCache;
+	static const int kClassCount = 4 * 15; // four classes per power of two, 64 KB to 1 GB
+
+	MatPool() = default;
+	void *Acquire(size_t bytes) const;
+	void Recycle(void *buffer, size_t bytes) const;
+	// Returns false when the shared pool is full and the buffer must be freed.
+	bool Store(int index, void *buffer, size_t bytes) const;
+
+	mutable std::mutex mMutex;
+	mutable std::vector<void *> mFree[kClassCount];
+	mutable size_t mPoolBytes = 0;
+	size_t mBudget = 512u << 20;
+
+	mutable std::atomic<size_t> mRequests{0};
+	mutable std::atomic<size_t> mReused{0};
+	mutable std::atomic<size_t> mSystemAllocs{0};
+	mutable std::atomic<size_t> mBytesInUse{0};
+	mutable std::atomic<size_t> mPeakBytesInUse{0};
+	mutable std::atomic<size_t> mBytesCached{0};
+};
+#endif
@@ -0,0 +1,1104 @@
+#include "application.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <mutex>
+#include "nfd.h"
+#include "exporter.h"
+#include "manifest.h"
+#include "allocator.h"
+#include "logger.h"
+#include "opencv2/highgui.hpp"
+
+static const int kThumbnailSize = 256;
+static const int kPreviewGranularity = 256;
+static const int kPreviewMaxSide = 2048;
+static const int kTilesPerFrame = 4;
+// mLoadedIdex that matches no index, not even the -1 of an empty list, so the next frame reloads
+static const int kReloadIndex = -2;
+// Longest side of the preview composed while a setting is being dragged
+static const int kDraftMaxSide = 512;
+static const std::chrono::milliseconds kRefineDelay(150);
+// Drafts sample a source reduced once per image, their cost does not grow with the photo
+static const int kDraftSourceMaxSide = 2 * kDraftMaxSide;
+// Thumbnails are 8-bit BGR, full images go through LoadSource.
+// EXIF orientation is applied while resampling, never by a separate decode-time rotation
+static const int kThumbnailFlags = cv::IMREAD_COLOR | cv::IMREAD_IGNORE_ORIENTATION;
+
+// Decode on a worker, the draft source is reduced there too.
+static DecodedImage DecodeImage(const std::string &path)
+{
+	DecodedImage decoded;
+	decoded.image = LoadSource(path);
+	int maxSide = std::max(decoded.image.cols, decoded.image.rows);
+	if (maxSide > kDraftSourceMaxSide)
+	{
+		double scale = kDraftSourceMaxSide / (double)maxSide;
+		cv::resize(decoded.image, decoded.draft, cv::Size(), scale, scale, cv::INTER_AREA);
+	}
+	else
+	{
+		decoded.draft = decoded.image;
+	}
+	return decoded;
+}
+
+// Key of an export target, two spellings of the same path give the same key.
+static std::string ExportKey(const std::string &path)
+{
+	std::error_code error;
+	std::filesystem::path absolute = std::filesystem::absolute(path, error);
+	std::filesystem::path normal = (error ? std::filesystem::path(path) : absolute).lexically_normal();
+	if (!normal.has_filename())
+		normal = normal.parent_path();
+	return normal.string();
+}
+
+// State shared by the jobs of one Save All, the last job to finish prunes and saves the manifest.
+// The folder stays registered until every job is done or dropped.
+struct FolderExport
+{
+	FolderExport(const std::string &folder, std::shared_ptr<ExportRegistry> registry)
+		: folder(folder), key(ExportKey(folder)), manifest(folder), registry(std::move(registry)) {}
+
+	~FolderExport()
+	{
+		if (!registered)
+			return;
+		// JobSystem::Stop dropped the jobs left, keep what the others exported
+		if (remaining > 0)
+		{
+			LOG_WARN("Save all to %s stopped, %d images not exported", folder.c_str(), remaining.load());
+			if (!manifest.Save())
+				LOG_WARN("Cannot write the export manifest of %s", folder.c_str());
+		}
+		std::lock_guard<std::mutex> lock(registry->mutex);
+		registry->folders.erase(key);
+	}
+
+	std::string folder;
+	std::string key;
+	std::mutex mutex;
+	ExportManifest manifest;
+	std::shared_ptr<ExportRegistry> registry;
+	bool registered = false;
+	std::atomic<int> remaining{0};
+	std::atomic<bool> failed{false};
+};
+
+// The output of one Save As, registered until its job is done or dropped.
+struct FileExport
+{
+	FileExport(const std::string &path, std::shared_ptr<ExportRegistry> registry)
+		: path(path), key(ExportKey(path)), registry(std::move(registry)) {}
+
+	~FileExport()
+	{
+		if (!registered)
+			return;
+		if (!done)
+			LOG_WARN("Save as %s stopped before it started", path.c_str());
+		std::lock_guard<std::mutex> lock(registry->mutex);
+		registry->files.erase(key);
+	}
+
+	std::string path;
+	std::string key;
+	std::shared_ptr<ExportRegistry> registry;
+	bool registered = false;
+	bool done = false;
+};
+
+ImageInfo::ImageInfo(std::string _path)
+	: mPath(_path)
+{
+	// the header gives size and orientation without decoding, the thumbnail is decoded by a job
+	mProbed = ProbeImageHeader(mPath, mHeader);
+	mOrientation = mProbed ? mHeader.orientation : 1;
+	cv::Size size = OrientedSize(mHeader.size, mOrientation);
+	mWidth = size.width;
+	mHeight = size.height;
+}
+
+void ImageInfo::LoadThumbnail(const Ref<ImageInfo> &image, const CancelToken &token)
+{
+	std::weak_ptr<ImageInfo> weak = image;
+	std::string path = image->mPath;
+	ImageHeader header = image->mHeader;
+	bool probed = image->mProbed;
+	JobSystem::Get().Submit(JobPriority::Visible, [weak, path, header, probed, token]()
+	{
+		// large JPEGs decode at a reduced scale when the header gave their size
+		int flags = kThumbnailFlags;
+		if (probed)
+		{
+			int reduce = std::max(header.size.width, header.size.height) / kThumbnailSize;
+			flags |= reduce >= 8 ? cv::IMREAD_REDUCED_COLOR_8 : reduce >= 4 ? cv::IMREAD_REDUCED_COLOR_4 : reduce >= 2 ? cv::IMREAD_REDUCED_COLOR_2 : 0;
+		}
+		cv::Mat img = cv::imread(path, flags);
+		int orientation = probed ? header.orientation : 1;
+		cv::Size size = OrientedSize(probed ? header.size : img.size(), orientation);
+		if (!img.empty())
+		{
+			// keep the aspect ratio, the mip chain takes care of the final downscale in the strip
+			double scale = std::min(1.0, kThumbnailSize / (double)std::max(img.cols, img.rows));
+			cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_AREA);
+			ApplyOrientation(img, orientation);
+		}
+		JobSystem::Get().Post([weak, img, size]()
+		{
+			if (Ref<ImageInfo> image = weak.lock())
+				image->SetThumbnail(img, size);
+		}, token);
+	}, token);
+}
+
+void ImageInfo::SetThumbnail(const cv::Mat &img, cv::Size size)
+{
+	mWidth = size.width;
+	mHeight = size.height;
+	if (img.empty())
+		return;
+	mTexture = TexturePool::Get().Acquire(img.cols, img.rows, GL_RGB8, true);
+	mTexture.Upload(img.data, GL_BGR, GL_UNSIGNED_BYTE, (int)(img.step / img.elemSize()));
+}
+
+void Application::Frame()
+{
+	JobSystem::Get().DrainMainThread();
+	MenuBarFunction();
+	WatchFolder();
+	Inspection();
+	ViewFunction();
+}
+
+void Application::MenuBarFunction()
+{
+	if (ImGui::BeginMainMenuBar())
+	{
+		if (ImGui::BeginMenu("File"))
+		{
+			if (ImGui::MenuItem("New File...", "Ctrl+N"))
+			{
+				Reset();
+			}
+			if (ImGui::MenuItem("Open File...", "Ctrl+O"))
+			{
+				nfdpathset_t outPaths;
+				// nfdchar_t *outPath = NULL;
+				// GTK filters are case sensitive, list the upper case spellings too
+				nfdresult_t result = NFD_OpenDialogMultiple("png,jpg,jpeg,tif,tiff,PNG,JPG,JPEG,TIF,TIFF", NULL, &outPaths);
+				if (result == NFD_OKAY)
+				{
+					LOG_INFO("Open %zu files", NFD_PathSet_GetCount(&outPaths));
+					std::vector<std::string> paths;
+					for (size_t i = 0; i < NFD_PathSet_GetCount(&outPaths); ++i)
+						paths.push_back(NFD_PathSet_GetPath(&outPaths, i));
+					NFD_PathSet_Free(&outPaths);
+					OpenFiles(paths);
+				}
+				else if (result == NFD_CANCEL)
+				{
+					LOG_DEBUG("User pressed cancel.");
+				}
+				else
+				{
+					LOG_ERROR("Open File: %s", NFD_GetError());
+				}
+			}
+
+			if (ImGui::MenuItem("Open Folder...", "Ctrl+Shift+O"))
+			{
+				nfdchar_t *outPath = NULL;
+				nfdresult_t result = NFD_PickFolder( NULL, &outPath );
+				if ( result == NFD_OKAY )
+				{
+					LOG_INFO("Open folder %s", outPath);
+					OpenFolder(outPath);
+					free(outPath);
+				}
+				else if ( result == NFD_CANCEL )
+				{
+					LOG_DEBUG("User pressed cancel.");
+				}
+				else 
+				{
+					LOG_ERROR("Open Folder: %s", NFD_GetError());
+				}
+			}
+
+			if (ImGui::MenuItem("Save As...", "Ctrl+S"))
+			{
+				nfdchar_t *savePath = NULL;
+				nfdresult_t result = NFD_SaveDialog("png;jpg;tif", mCurrentImagePath.c_str(), &savePath);
+				if (result == NFD_OKAY)
+				{
+					LOG_INFO("Save %s", savePath);
+					SaveFile(savePath);
+					free(savePath);
+				}
+				else if (result == NFD_CANCEL)
+				{
+					LOG_DEBUG("User pressed cancel.");
+				}
+				else
+				{
+					LOG_ERROR("Save As: %s", NFD_GetError());
+				}
+			}
+
+			if (ImGui::MenuItem("Save All", "Ctrl+Shift+S"))
+			{
+				nfdchar_t *outPath = NULL;
+				nfdresult_t result = NFD_PickFolder( NULL, &outPath );
+				if ( result == NFD_OKAY )
+				{
+					LOG_INFO("Save all to %s", outPath);
+					SaveFolder(outPath);
+					free(outPath);
+				}
+				else if ( result == NFD_CANCEL )
+				{
+					LOG_DEBUG("User pressed cancel.");
+				}
+				else 
+				{
+					LOG_ERROR("Save All: %s", NFD_GetError());
+				}
+			}
+
+			if (ImGui::MenuItem("Exit"))
+			{
+				exit_app = true;
+			}
+			ImGui::EndMenu();
+		}
+
+		if (ImGui::BeginMenu("Edit"))
+		{
+			if (ImGui::MenuItem("Undo", "Ctrl+Z"))
+			{
+			}
+			if (ImGui::MenuItem("Redo", "Ctrl+Y"))
+			{
+			}
+			ImGui::EndMenu();
+		}
+
+		if (ImGui::BeginMenu("View"))
+		{
+			ImGui::MenuItem("Grid", nullptr, &mGridView);
+			ImGui::EndMenu();
+		}
+
+		if (ImGui::BeginMenu("Help"))
+		{
+			if (ImGui::MenuItem("About"))
+			{
+				ImGui::OpenPopup("AboutMe");
+
+				if (ImGui::BeginPopupModal("AboutMe"))
+				{
+					ImGui::Text("This is about.");
+					ImGui::EndPopup();
+				}
+			}
+
+			ImGui::EndMenu();
+		}
+		ImGui::EndMainMenuBar();
+	}
+}
+
+void Application::ViewFunction()
+{
+	ImGuiIO& io = ImGui::GetIO();
+	ImVec2 screen_size = ImVec2(io.DisplaySize.x, io.DisplaySize.y);
+	{
+		// Set the next window position to the left side of the screen
+		//ImGui::SetNextWindowPos(ImVec2(screen_size.x / 4, 0));
+		ImGui::SetNextWindowSize(ImVec2(screen_size.x / 4, screen_size.y));
+		//ImGui::SetNextWindowPos(ImVec2(io.DisplacP, 0));
+		ImGui::Begin("Setting", nullptr, ImGuiWindowFlags_NoCollapse); // Pass a pointer to our bool variable (the window will have a closing button that will clear the bool when clicked)
+		ImGui::Text("texture pos = %d", mTexture.GetID());
+		cv::Size currentSize = {0, 0};
+
+		if (!mImageList.empty())
+		{
+			currentSize = cv::Size(mImageList[mCurrentIdex]->GetWidth(),mImageList[mCurrentIdex]->GetHeight());
+		}
+
+		ImGui::Text("size = %d x %d", currentSize.width, currentSize.height);
+		JobSystem &jobs = JobSystem::Get();
+		ImGui::Text("jobs = %zu / %zu / %zu / %zu", jobs.GetQueueDepth(JobPriority::Interactive), jobs.GetQueueDepth(JobPriority::Visible),
+					jobs.GetQueueDepth(JobPriority::Prefetch), jobs.GetQueueDepth(JobPriority::Batch));
+		ImGui::Checkbox("grid", &mGridView);
+		if (mGridView)
+		{
+			ImGui::SameLine();
+			ImGui::SliderFloat("##cell", &mGridCell, 120.0f, 480.0f, "cell %.0f px");
+		}
+		ImGui::Text("zoom = %.0f%%", GetViewZoom() * 100.0f);
+		ImGui::SameLine();
+		if (ImGui::SmallButton("Fit"))
+			mZoom = 0.0f;
+		ImGui::SameLine();
+		if (ImGui::SmallButton("1:1"))
+			mZoom = 1.0f;
+		{
+			ImGui::PushMultiItemsWidths(2, ImGui::CalcItemWidth());
+			ImGui::PushID("width");
+			ImGuiContext &g = *GImGui;
+			ImGui::TextUnformatted("width:");
+			ImGui::SameLine(0, g.Style.ItemInnerSpacing.x);
+			ImGui::DragFloat("##hidelabel", &mWidth, 0.1f, 1.0f, 100.0f);
+			ImGui::PopID();
+			ImGui::PushID("height");
+			ImGui::SameLine(0, g.Style.ItemInnerSpacing.x);
+			ImGui::TextUnformatted("height:");
+			ImGui::SameLine(0, g.Style.ItemInnerSpacing.x);
+			ImGui::DragFloat("##hidelabel", &mHeight, 0.1f, 1.0f, 100.0f);
+			ImGui::PopItemWidth();
+			ImGui::PopID();
+			ImGui::PushID("border");
+			ImGui::TextUnformatted("border offset");
+			ImGui::SameLine();
+			ImGui::DragFloat("##hidelabel", &mBorderOfset, 0.01f, 0.00f, 50.00f);
+			ImGui::PopID();
+			ImGui::PushID("bottom");
+			ImGui::TextUnformatted("bottom offset");
+			ImGui::SameLine();
+			ImGui::DragFloat("##hidelabel", &mBottomOfset, 0.01f, 0.00f, 50.00f);
+			ImGui::PopItemWidth();
+			ImGui::PopID();
+			ImGui::PushID("ppi");
+			ImGui::TextUnformatted("resolution (ppi)");
+			ImGui::SameLine();
+			ImGui::DragInt("##hidelabel", &mPPI, 1.0f, 72, 2400);
+			ImGui::PopID();
+			ImGui::Checkbox("auto portrait / landscape", &mAutoOrient);
+		}
+
+		//{
+		//	ImGui::BeginGroup();
+		//	ImGui::TextUnformatted("width"); ImGui::SameLine(); ImGui::DragFloat("##hidelabel", &mWidth, 0.1f);
+		//	ImGui::EndGroup();
+		//}
+		// ImGui::TextUnformatted("height"); ImGui::SameLine(); ImGui::DragFloat("##hidelabel", &mHeight, 0.1f);
+		ImGui::PushID("background");
+		ImGui::TextUnformatted("background");
+		ImGui::SameLine();
+		ImGui::ColorEdit3("##hidelabel", (float *)&mBgColor);
+		ImGui::PopID();
+		ImGui::TextUnformatted("border");
+		ImGui::SameLine();
+		ImGui::ColorEdit3("##hidelabel", (float *)&mBorderColor);
+		ImGui::End();
+	}
+
+	if (mGridView)
+	{
+		ImGui::SetNextWindowSize(ImVec2(screen_size.x * 3 / 4, screen_size.y * 3 / 4));
+		ImGui::PushStyleColor(ImGuiCol_WindowBg, IM_COL32(20, 20, 20, 255));
+		ImGui::Begin("View", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar);
+		DrawGrid();
+		ImGui::End();
+		ImGui::PopStyleColor();
+	}
+	else
+	{
+		ImGui::SetNextWindowSize(ImVec2(screen_size.x * 3 / 4, screen_size.y * 3 / 4));
+		ImGui::PushStyleColor(ImGuiCol_WindowBg, IM_COL32(20, 20, 20, 255));
+		ImGui::Begin("View", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+		int border = 20;
+		ImVec2 windowPos = ImGui::GetWindowPos();
+		ImVec2 currentWindowSize = ImGui::GetWindowSize();
+		ImVec2 windowSize(currentWindowSize.x - border * 2, currentWindowSize.y - border * 2);
+		ImVec2 frameSize(static_cast<float>(mLayout.size.width), static_cast<float>(mLayout.size.height));
+		ImVec2 newSize = GetScaleImageSize(frameSize, windowSize);
+		mFitZoom = frameSize.x > 0 ? newSize.x / frameSize.x : 0.0f;
+
+		// The whole pane is a canvas: wheel zooms around the cursor, drag pans, double click toggles fit / 1:1
+		ImGui::SetCursorPos(ImVec2(0, 0));
+		ImGui::InvisibleButton("canvas", ImVec2(std::max(currentWindowSize.x, 1.0f), std::max(currentWindowSize.y, 1.0f)));
+		ImGuiIO &viewIo = ImGui::GetIO();
+		ImVec2 viewCenter(windowPos.x + currentWindowSize.x * 0.5f, windowPos.y + currentWindowSize.y * 0.5f);
+		if (ImGui::IsItemHovered() && viewIo.MouseWheel != 0.0f && mFitZoom > 0.0f)
+		{
+			float zoom = GetViewZoom();
+			float newZoom = std::clamp(zoom * std::pow(1.25f, viewIo.MouseWheel), mFitZoom, std::max(mFitZoom, 8.0f));
+			ImVec2 anchor(mPan.x + (viewIo.MousePos.x - viewCenter.x) / zoom, mPan.y + (viewIo.MousePos.y - viewCenter.y) / zoom);
+			mPan = ImVec2(anchor.x - (viewIo.MousePos.x - viewCenter.x) / newZoom, anchor.y - (viewIo.MousePos.y - viewCenter.y) / newZoom);
+			mZoom = newZoom <= mFitZoom ? 0.0f : newZoom;
+		}
+		if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+		{
+			mZoom = mZoom > 0.0f ? 0.0f : 1.0f;
+		}
+		if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left) && mZoom > 0.0f)
+		{
+			mPan = ImVec2(mPan.x - viewIo.MouseDelta.x / mZoom, mPan.y - viewIo.MouseDelta.y / mZoom);
+		}
+		if (mZoom <= 0.0f)
+		{
+			mPan = ImVec2(frameSize.x * 0.5f, frameSize.y * 0.5f);
+		}
+		mPan = ImVec2(std::clamp(mPan.x, 0.0f, frameSize.x), std::clamp(mPan.y, 0.0f, frameSize.y));
+
+		float zoom = GetViewZoom();
+		ImVec2 origin(viewCenter.x - mPan.x * zoom, viewCenter.y - mPan.y * zoom);
+		ImDrawList *draw_list = ImGui::GetWindowDrawList();
+		draw_list->AddImage((void *)(intptr_t)mTexture.GetID(), origin, ImVec2(origin.x + frameSize.x * zoom, origin.y + frameSize.y * zoom), ImVec2(0, 0), ImVec2(mTexture.GetU(), mTexture.GetV()));
+		// tiles are composed on the main thread, skip them until the preview is refined
+		if (mPreviewScale < 1.0 && zoom > mPreviewScale * 1.01 && !mPreviewDraft)
+		{
+			DrawTiles(draw_list, origin, zoom, windowPos, currentWindowSize);
+		}
+		ImGui::End();
+		ImGui::PopStyleColor();
+	}
+
+	{
+		ImGui::SetNextWindowSize(ImVec2(screen_size.x / 4, screen_size.y / 4));
+		ImGui::PushStyleColor(ImGuiCol_WindowBg, IM_COL32(20, 20, 20, 255));
+		ImGui::Begin("Image List", NULL, ImGuiWindowFlags_HorizontalScrollbar | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar);
+		int border = 30;
+		ImVec2 currentWindowSize = ImGui::GetWindowSize();
+		int currentCursorPosX = border / 2;
+		for (int i = 0; i < mImageList.size(); i++)
+		{
+			const auto &tex = mImageList[i]->GetTexture();
+			ImVec2 windowSize(ImGui::GetWindowSize().x, ImGui::GetWindowSize().y - border);
+			// the header size lays the strip out before the thumbnail job has finished
+			ImVec2 image_size = GetScaleImageSize(ImVec2(static_cast<float>(std::max(1, mImageList[i]->GetWidth())), static_cast<float>(std::max(1, mImageList[i]->GetHeight()))), windowSize);
+			ImVec2 image_pos = ImVec2(currentCursorPosX, border);
+			ImGui::SetCursorPos(image_pos);
+			if (tex)
+			{
+				ImGui::Image((void *)(intptr_t)tex.GetID(), image_size);
+			}
+			else
+			{
+				ImVec2 screen_pos = ImGui::GetCursorScreenPos();
+				ImGui::Dummy(image_size);
+				ImGui::GetWindowDrawList()->AddRectFilled(screen_pos, ImVec2(screen_pos.x + image_size.x, screen_pos.y + image_size.y), IM_COL32(60, 60, 60, 255));
+			}
+
+			// Check if the imgui::image was double-clicked
+			if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left) && i != mCurrentIdex)
+			{
+				mPreviousIdex = mCurrentIdex;
+				mCurrentIdex = i;
+			}
+
+			if(i == mCurrentIdex)
+			{
+				// Get the position and size of the imgui::image
+				// Draw a border around the imgui::image
+				ImDrawList* draw_list = ImGui::GetWindowDrawList();
+				ImVec2 border_min = ImVec2(image_pos.x - 1, image_pos.y - 1);
+				ImVec2 border_max = ImVec2(image_pos.x + image_size.x + 1, image_pos.y + image_size.y + 1);
+				draw_list->AddRect(border_min, border_max, IM_COL32(0, 255, 255, 255));
+			}
+
+			currentCursorPosX += image_size.x + border / 2;
+		}
+		// Get the maximum horizontal scrolling position
+		//float max_scroll_x = ImGui::GetScrollMaxX();
+
+		// Set the horizontal scrolling position
+		//ImGui::SetScrollX(max_scroll_x);
+		if (mStripScroll >= 0.0f)
+		{
+			ImGui::SetScrollX(std::min(mStripScroll, ImGui::GetScrollMaxX()));
+			mStripScroll = -1.0f;
+		}
+		ImGui::End();
+		ImGui::PopStyleColor();
+	}
+}
+
+void Application::OpenFiles(const std::vector<std::string> &paths)
+{
+	mWatcher.Close();
+	ClearImages();
+	mPreviousIdex = mCurrentIdex = 0;
+	mLoadedIdex = kReloadIndex;
+	for (const auto &path : paths)
+		mImageList.push_back(CreateImage(path));
+}
+
+void Application::OpenFolder(const std::string &folder)
+{
+	ClearImages();
+	mPreviousIdex = mCurrentIdex = 0;
+	mLoadedIdex = kReloadIndex;
+	// start watching before the listing so files arriving meanwhile are not missed,
+	// an early event for a listed file only replaces its entry
+	mWatcher.Open(folder);
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+		if (entry.is_regular_file()) {
+			std::string file_path = entry.path().string();
+			if (IsImageFile(file_path))
+				mImageList.push_back(CreateImage(file_path));
+		}
+	}
+}
+
+void Application::SaveFile(std::string path)
+{
+	if (mCurrentMat.empty())
+	{
+		LOG_WARN("No image to save as %s", path.c_str());
+		return;
+	}
+	// The preview texture is bounded in size, compose the print resolution frame from the source.
+	// Bands are streamed to the encoder so the full canvas never exists in memory.
+	cv::Mat image = mCurrentMat;
+	FrameLayout layout = MakeFrameLayout(GetFrameSettings(), mCurrentMat.size(), mCurrentOrientation);
+	auto output = std::make_shared<FileExport>(path, mExports);
+	{
+		std::lock_guard<std::mutex> lock(mExports->mutex);
+		std::string folder = std::filesystem::path(output->key).parent_path().string();
+		if (mExports->folders.count(folder) || !mExports->files.insert(output->key).second)
+		{
+			LOG_WARN("%s is still being saved, try again once it is done", path.c_str());
+			return;
+		}
+		output->registered = true;
+	}
+	JobSystem::Get().Submit(JobPriority::Batch, [image, layout, output]()
+	{
+		output->done = true;
+		if (!ExportFrame(image, layout, output->path))
+			LOG_ERROR("Export failed: %s", output->path.c_str());
+	});
+}
+
+void Application::SaveFolder(std::string folderPath)
+{
+	if (mImageList.empty())
+		return;
+
+	FrameSettings settings = GetFrameSettings();
+	uint64_t settingsHash = HashFrameSettings(settings);
+	// outputs whose source and settings are unchanged since the last export are skipped without decoding
+	auto batch = std::make_shared<FolderExport>(folderPath, mExports);
+	{
+		// a Save As into the folder could be overwritten, another Save All would race on the manifest
+		std::lock_guard<std::mutex> lock(mExports->mutex);
+		bool busy = mExports->folders.count(batch->key) > 0;
+		for (auto it = mExports->files.begin(); !busy && it != mExports->files.end(); ++it)
+			busy = std::filesystem::path(*it).parent_path().string() == batch->key;
+		if (busy)
+		{
+			LOG_WARN("%s is still being saved, try again once it is done", folderPath.c_str());
+			return;
+		}
+		mExports->folders.insert(batch->key);
+		batch->registered = true;
+	}
+	batch->manifest.Load();
+	batch->remaining = (int)mImageList.size();
+
+	// one batch job per image, they run beside the interactive work
+	for (auto &img : mImageList)
+	{
+		std::string path = img->GetPath();
+		std::string name = img->GetName();
+		int orientation = img->GetOrientation();
+		JobSystem::Get().Submit(JobPriority::Batch, [batch, settings, settingsHash, path, name, orientation, folderPath]()
+		{
+			ManifestEntry entry;
+			bool described = ExportManifest::Describe(path, name, settingsHash, entry);
+			bool upToDate = false;
+			if (described)
+			{
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				upToDate = batch->manifest.IsUpToDate(entry);
+			}
+
+			if (!upToDate && !batch->failed)
+			{
+				cv::Mat image = LoadSource(path);
+				FrameLayout layout = MakeFrameLayout(settings, image.size(), orientation);
+				// a black window must not be recorded as up to date, the next Save All tries again
+				if (image.empty())
+				{
+					LOG_ERROR("Cannot decode %s", path.c_str());
+				}
+				// crash when input width, height
+				else if (layout.borderRect.empty())
+				{
+					batch->failed = true;
+					LOG_ERROR("Invalid frame settings, Save All stopped");
+				}
+				else if (!ExportFrame(image, layout, (std::filesystem::path(folderPath) / name).string()))
+				{
+					LOG_ERROR("Export failed: %s", path.c_str());
+				}
+				else
+				{
+					LOG_DEBUG("Exported %s", name.c_str());
+					if (described)
+					{
+						std::lock_guard<std::mutex> lock(batch->mutex);
+						batch->manifest.Update(entry);
+					}
+				}
+			}
+			else if (upToDate)
+			{
+				LOG_DEBUG("Up to date %s", name.c_str());
+			}
+
+			if (--batch->remaining == 0)
+			{
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				// only outputs listed in the manifest are deleted, never other files of the folder
+				if (!batch->failed)
+					batch->manifest.Prune();
+				if (!batch->manifest.Save())
+					LOG_WARN("Cannot write the export manifest of %s", folderPath.c_str());
+				LOG_INFO("Save all to %s done", folderPath.c_str());
+			}
+		});
+	}
+}
+
+FrameSettings Application::GetFrameSettings()
+{
+	FrameSettings settings;
+	settings.width = mWidth;
+	settings.height = mHeight;
+	settings.borderOffset = mBorderOfset;
+	settings.bottomOffset = mBottomOfset;
+	settings.ppi = mPPI;
+	settings.autoOrient = mAutoOrient;
+	settings.bgColor = vec2scalar(mBgColor);
+	settings.borderColor = vec2scalar(mBorderColor);
+	return settings;
+}
+
+void Application::SetFrameSettings(const FrameSettings &settings)
+{
+	mWidth = settings.width;
+	mHeight = settings.height;
+	mBorderOfset = settings.borderOffset;
+	mBottomOfset = settings.bottomOffset;
+	mPPI = settings.ppi;
+	mAutoOrient = settings.autoOrient;
+	mBgColor = ImVec4(settings.bgColor[2] / 255.0f, settings.bgColor[1] / 255.0f, settings.bgColor[0] / 255.0f, 1.0f);
+	mBorderColor = ImVec4(settings.borderColor[2] / 255.0f, settings.borderColor[1] / 255.0f, settings.borderColor[0] / 255.0f, 1.0f);
+}
+
+void Application::SelectImage(int index)
+{
+	if (index < 0 || index >= (int)mImageList.size() || index == mCurrentIdex)
+		return;
+	mPreviousIdex = mCurrentIdex;
+	mCurrentIdex = index;
+}
+
+bool Application::IsIdle() const
+{
+	// a job posts its result before it stops counting as running, check in that order
+	JobSystem &jobs = JobSystem::Get();
+	for (int priority = 0; priority < JOB_PRIORITY_COUNT; priority++)
+	{
+		if (jobs.GetQueueDepth((JobPriority)priority))
+			return false;
+	}
+	if (jobs.GetRunningCount() || jobs.GetMainQueueDepth())
+		return false;
+	std::string current = mImageList.empty() ? std::string() : mImageList[mCurrentIdex]->GetPath();
+	return mCurrentPath == current && !mFrameDirty && !mPreviewDraft;
+}
+
+void Application::Inspection()
+{
+	int index = mImageList.empty() ? -1 : mCurrentIdex;
+	if (index != mLoadedIdex)
+	{
+		LoadCurrentImage(index);
+		mLoadedIdex = index;
+		mPreviousIdex = mCurrentIdex;
+	}
+
+	FrameSettings settings = GetFrameSettings();
+	if (settings != mFrameSettings)
+	{
+		mFrameSettings = settings;
+		mFrameDirty = true;
+		mLastEdit = std::chrono::steady_clock::now();
+	}
+
+	if (mFrameDirty)
+	{
+		mFrameDirty = false;
+		ComposeDraft();
+	}
+
+	// refine once the settings have been left alone for a moment, a new image does not wait
+	if (mPreviewDraft && !mRefineQueued && std::chrono::steady_clock::now() - mLastEdit >= kRefineDelay)
+	{
+		RefinePreview();
+	}
+}
+
+void Application::ComposeDraft()
+{
+	// whatever is being refined belongs to the previous settings
+	mComposeToken.Cancel();
+	mComposeToken = CancelToken();
+	mRefineQueued = false;
+	mTiles.Clear();
+
+	mLayout = MakeFrameLayout(mFrameSettings, mCurrentMat.size(), mCurrentOrientation);
+	if (mLayout.empty())
+	{
+		mPreviewDraft = false;
+		return;
+	}
+
+	// The preview is capped to kPreviewMaxSide, the View pane streams pyramid tiles beyond that zoom
+	int maxSide = std::max(mLayout.size.width, mLayout.size.height);
+	mPreviewScale = std::min(1.0, kPreviewMaxSide / (double)maxSide);
+	// A small bilinear draft keeps every frame of a slider drag cheap, RefinePreview replaces it
+	double scale = std::min(mPreviewScale, kDraftMaxSide / (double)maxSide);
+	cv::Size size(std::max(1, cvRound(mLayout.size.width * scale)), std::max(1, cvRound(mLayout.size.height * scale)));
+	mPreviewDraft = scale < mPreviewScale;
+	cv::Mat draft;
+	ComposeRegion(mPreviewDraft ? mDraftMat : mCurrentMat, mLayout, cv::Rect(cv::Point(0, 0), size), scale, mPreviewDraft ? cv::INTER_LINEAR : cv::INTER_CUBIC, draft);
+	SetPreview(draft);
+}
+
+void Application::RefinePreview()
+{
+	mRefineQueued = true;
+	cv::Size size(std::max(1, cvRound(mLayout.size.width * mPreviewScale)), std::max(1, cvRound(mLayout.size.height * mPreviewScale)));
+	// the job keeps its own references, mCurrentMat is only ever replaced, never written to
+	JobSystem::Get().Submit(JobPriority::Interactive, [this, image = mCurrentMat, layout = mLayout, scale = mPreviewScale, size, token = mComposeToken]()
+	{
+		cv::Mat preview;
+		ComposeRegion(image, layout, cv::Rect(cv::Point(0, 0), size), scale, cv::INTER_CUBIC, preview);
+		JobSystem::Get().Post([this, preview]()
+		{
+			SetPreview(preview);
+			mPreviewDraft = false;
+		}, token);
+	}, mComposeToken);
+}
+
+void Application::SetPreview(const cv::Mat &preview)
+{
+	// update OpenGL texture if size has changed
+	if (preview.cols != mTexture.GetWidth() || preview.rows != mTexture.GetHeight())
+	{
+		AcquirePreviewTexture(preview.size());
+	}
+	mTexture.Upload(preview.data, GL_BGR);
+}
+
+Ref<ImageInfo> Application::CreateImage(const std::string &path)
+{
+	Ref<ImageInfo> image = CreateRef<ImageInfo>(path);
+	ImageInfo::LoadThumbnail(image, mListToken);
+	return image;
+}
+
+void Application::ClearImages()
+{
+	mListToken.Cancel();
+	mListToken = CancelToken();
+	mLoadToken.Cancel();
+	mLoadToken = CancelToken();
+	mPrefetched.clear();
+	mPrefetching.clear();
+	mGrid.Clear();
+	for (auto &image : mImageList)
+		image->Release();
+	mImageList.clear();
+}
+
+void Application::LoadCurrentImage(int index)
+{
+	mLoadToken.Cancel();
+	mLoadToken = CancelToken();
+	if (index < 0)
+	{
+		mCurrentMat = cv::Mat();
+		mDraftMat = cv::Mat();
+		mCurrentPath.clear();
+		mCurrentOrientation = 1;
+		mFrameDirty = true;
+		return;
+	}
+
+	// keep the image being left, stepping back is then free as well
+	if (!mCurrentMat.empty() && !mCurrentPath.empty())
+		mPrefetched[mCurrentPath] = {mCurrentMat, mDraftMat};
+
+	std::string path = mImageList[index]->GetPath();
+	int orientation = mImageList[index]->GetOrientation();
+	auto it = mPrefetched.find(path);
+	if (it != mPrefetched.end())
+	{
+		SetCurrentImage(path, it->second, orientation);
+	}
+	else
+	{
+		JobSystem::Get().Submit(JobPriority::Interactive, [this, path, orientation, token = mLoadToken]()
+		{
+			DecodedImage decoded = DecodeImage(path);
+			JobSystem::Get().Post([this, path, decoded, orientation]() { SetCurrentImage(path, decoded, orientation); }, token);
+		}, mLoadToken);
+	}
+	Prefetch(index);
+}
+
+void Application::SetCurrentImage(const std::string &path, const DecodedImage &decoded, int orientation)
+{
+	mCurrentPath = path;
+	mCurrentMat = decoded.image;
+	mDraftMat = decoded.draft;
+	mCurrentOrientation = orientation;
+	mFrameDirty = true;
+}
+
+void Application::Prefetch(int index)
+{
+	std::unordered_set<std::string> keep;
+	for (int i : {index - 1, index + 1})
+	{
+		if (i < 0 || i >= (int)mImageList.size())
+			continue;
+		std::string path = mImageList[i]->GetPath();
+		keep.insert(path);
+		if (mPrefetched.count(path) || mPrefetching.count(path))
+			continue;
+		mPrefetching.insert(path);
+		JobSystem::Get().Submit(JobPriority::Prefetch, [this, path, token = mListToken]()
+		{
+			DecodedImage decoded = DecodeImage(path);
+			JobSystem::Get().Post([this, path, decoded]()
+			{
+				mPrefetching.erase(path);
+				mPrefetched[path] = decoded;
+			}, token);
+		}, mListToken);
+	}
+	keep.insert(mImageList[index]->GetPath());
+	for (auto it = mPrefetched.begin(); it != mPrefetched.end();)
+		it = keep.count(it->first) ? std::next(it) : mPrefetched.erase(it);
+}
+
+void Application::WatchFolder()
+{
+	for (const auto &event : mWatcher.Poll())
+	{
+		if (!IsImageFile(event.path))
+			continue;
+		auto it = std::find_if(mImageList.begin(), mImageList.end(), [&](const Ref<ImageInfo> &image) { return image->GetPath() == event.path; });
+		int index = (int)(it - mImageList.begin());
+
+		if (event.change == FolderWatcher::Change::Removed)
+		{
+			if (it == mImageList.end())
+				continue;
+			(*it)->Release();
+			mImageList.erase(it);
+			// the shown image only moves down when an earlier one is removed, no need to decode it again
+			if (index < mCurrentIdex)
+			{
+				mCurrentIdex--;
+				if (mLoadedIdex == mCurrentIdex + 1)
+					mLoadedIdex = mCurrentIdex;
+			}
+			else if (index == mCurrentIdex)
+			{
+				mCurrentIdex = std::min(mCurrentIdex, std::max(0, (int)mImageList.size() - 1));
+				mLoadedIdex = kReloadIndex;
+			}
+			mPreviousIdex = mCurrentIdex;
+			continue;
+		}
+
+		if (!std::filesystem::is_regular_file(event.path))
+			continue;
+		if (it != mImageList.end())
+		{
+			(*it)->Release();
+			*it = CreateImage(event.path);
+			// drop every decoded copy of the old content
+			mPrefetched.erase(event.path);
+			mGrid.Invalidate(event.path);
+			if (event.path == mCurrentPath)
+				mCurrentPath.clear();
+			if (index == mCurrentIdex)
+				mLoadedIdex = kReloadIndex;
+		}
+		else
+		{
+			mImageList.push_back(CreateImage(event.path));
+		}
+	}
+}
+
+void Application::DrawTiles(ImDrawList *draw_list, ImVec2 origin, float zoom, ImVec2 clipPos, ImVec2 clipSize)
+{
+	const int tileSize = TileCache::kTileSize;
+
+	// pick the coarsest level that still has at least one texel per screen pixel
+	int level = zoom >= 1.0f ? 0 : (int)std::floor(std::log2(1.0 / zoom));
+	double levelScale = std::ldexp(1.0, -level);
+	cv::Size levelSize(cvCeil(mLayout.size.width * levelScale), cvCeil(mLayout.size.height * levelScale));
+	double texelToScreen = zoom / levelScale;
+
+	// visible part of the level, in level pixels
+	int x0 = std::max(0, (int)std::floor((clipPos.x - origin.x) / texelToScreen) / tileSize);
+	int y0 = std::max(0, (int)std::floor((clipPos.y - origin.y) / texelToScreen) / tileSize);
+	int x1 = std::min((levelSize.width - 1) / tileSize, (int)std::floor((clipPos.x + clipSize.x - origin.x) / texelToScreen) / tileSize);
+	int y1 = std::min((levelSize.height - 1) / tileSize, (int)std::floor((clipPos.y + clipSize.y - origin.y) / texelToScreen) / tileSize);
+
+	// generate a few missing tiles per frame, nearest to the view center first, the preview covers the rest
+	std::vector<std::pair<float, cv::Point>> missing;
+	ImVec2 center(clipPos.x + clipSize.x * 0.5f, clipPos.y + clipSize.y * 0.5f);
+	for (int ty = y0; ty <= y1; ty++)
+	{
+		for (int tx = x0; tx <= x1; tx++)
+		{
+			if (!mTiles.Find(level, tx, ty))
+			{
+				float dx = origin.x + (tx + 0.5f) * tileSize * texelToScreen - center.x;
+				float dy = origin.y + (ty + 0.5f) * tileSize * texelToScreen - center.y;
+				missing.push_back({dx * dx + dy * dy, cv::Point(tx, ty)});
+			}
+		}
+	}
+	std::sort(missing.begin(), missing.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+	cv::Mat tile;
+	for (size_t i = 0; i < missing.size() && i < (size_t)kTilesPerFrame; i++)
+	{
+		cv::Point t = missing[i].second;
+		cv::Rect region = cv::Rect(t.x * tileSize, t.y * tileSize, tileSize, tileSize) & cv::Rect(cv::Point(0, 0), levelSize);
+		ComposeRegion(mCurrentMat, mLayout, region, levelScale, cv::INTER_CUBIC, tile);
+		Texture2D texture = TexturePool::Get().Acquire(region.width, region.height, GL_RGB8, false, tileSize);
+		texture.Upload(tile.data, GL_BGR);
+		mTiles.Insert(level, t.x, t.y, std::move(texture));
+	}
+
+	for (int ty = y0; ty <= y1; ty++)
+	{
+		for (int tx = x0; tx <= x1; tx++)
+		{
+			const Texture2D *texture = mTiles.Find(level, tx, ty);
+			if (!texture)
+				continue;
+			ImVec2 pmin(origin.x + tx * tileSize * texelToScreen, origin.y + ty * tileSize * texelToScreen);
+			ImVec2 pmax(pmin.x + texture->GetWidth() * texelToScreen, pmin.y + texture->GetHeight() * texelToScreen);
+			draw_list->AddImage((void *)(intptr_t)texture->GetID(), pmin, pmax, ImVec2(0, 0), ImVec2(texture->GetU(), texture->GetV()));
+		}
+	}
+}
+
+void Application::DrawGrid()
+{
+	const float spacing = 12.0f;
+	float pitch = mGridCell + spacing;
+	ImVec2 avail = ImGui::GetContentRegionAvail();
+	int columns = std::max(1, (int)((avail.x + spacing) / pitch));
+	int count = (int)mImageList.size();
+	int rows = (count + columns - 1) / columns;
+
+	// one item for the whole sheet, only the rows in view become instances
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImGui::InvisibleButton("grid", ImVec2(std::max(1.0f, columns * pitch), std::max(1.0f, rows * pitch)));
+	ImVec2 mouse = ImGui::GetIO().MousePos;
+	int column = (int)std::floor((mouse.x - origin.x) / pitch);
+	int row = (int)std::floor((mouse.y - origin.y) / pitch);
+	int hovered = ImGui::IsItemHovered() && column >= 0 && column < columns && row >= 0 ? row * columns + column : -1;
+	if (hovered >= 0 && hovered < count)
+	{
+		if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+			SelectImage(hovered);
+		if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+			mGridView = false;
+	}
+
+	float top = ImGui::GetScrollY();
+	float height = ImGui::GetWindowHeight();
+	int firstRow = std::max(0, (int)std::floor(top / pitch) - 1);
+	int lastRow = std::min(rows - 1, (int)std::ceil((top + height) / pitch));
+
+	ImDrawList *draw_list = ImGui::GetWindowDrawList();
+	mGrid.Begin();
+	for (int i = firstRow * columns; i <= std::min(count - 1, (lastRow + 1) * columns - 1); i++)
+	{
+		ImageInfo &image = *mImageList[i];
+		// thumbnails are upright, so is the frame
+		FrameLayout layout = MakeFrameLayout(mFrameSettings, cv::Size(image.GetWidth(), image.GetHeight()));
+		if (layout.empty())
+			continue;
+		ImVec2 cellMin(origin.x + (i % columns) * pitch, origin.y + (i / columns) * pitch);
+		ImVec2 size = GetScaleImageSize(ImVec2((float)layout.size.width, (float)layout.size.height), ImVec2(mGridCell, mGridCell));
+		ImVec2 min(cellMin.x + (mGridCell - size.x) * 0.5f, cellMin.y + (mGridCell - size.y) * 0.5f);
+		ImVec2 max(min.x + size.x, min.y + size.y);
+		mGrid.Add(image.GetPath(), image.GetTexture(), min, max, layout);
+		if (i == mCurrentIdex)
+			draw_list->AddRect(ImVec2(min.x - 2, min.y - 2), ImVec2(max.x + 2, max.y + 2), IM_COL32(0, 255, 255, 255), 0.0f, 0, 2.0f);
+	}
+	mGrid.Draw(draw_list);
+}
+
+void Application::AcquirePreviewTexture(cv::Size size)
+{
+	// nearby sizes share a bucket while dragging, the storage in use is kept for them
+	int storageWidth = (size.width + kPreviewGranularity - 1) / kPreviewGranularity * kPreviewGranularity;
+	int storageHeight = (size.height + kPreviewGranularity - 1) / kPreviewGranularity * kPreviewGranularity;
+	if (mTexture.GetStorageWidth() == storageWidth && mTexture.GetStorageHeight() == storageHeight && mTexture.Resize(size.width, size.height))
+		return;
+	// the old storage goes back to the pool before a new one is taken, never two at once
+	mTexture.Release();
+	mTexture = TexturePool::Get().Acquire(size.width, size.height, GL_RGB8, false, kPreviewGranularity);
+}
+
+void Application::Reset()
+{
+	mWatcher.Close();
+	ClearImages();
+	mCurrentIdex = mPreviousIdex = 0;
+	mLoadedIdex = kReloadIndex;
+	mCurrentMat = {};
+	mDraftMat = {};
+	mCurrentPath.clear();
+	mZoom = 0.0f;
+	mWidth = 6;
+	mHeight = 9;
+	mBorderOfset = 0.25;
+	mPPI = DEFAULT_PPI;
+	mAutoOrient = true;
+	mBgColor = {1.0f, 1.0f, 1.0f, 1.0f};
+	mBorderColor = {1.0f, 1.0f, 1.0f, 1.0f};
+	mFrameDirty = true;
+	MatPool::Get().Trim();
+}
+
+Application::~Application()
+{
+	// pending jobs reference the application, running exports are finished first
+	mListToken.Cancel();
+	mLoadToken.Cancel();
+	mComposeToken.Cancel();
+	JobSystem::Get().Stop();
+	mTiles.Clear();
+	mTexture.Release();
+	mGrid.Release();
+	for (auto &image : mImageList)
+		image->Release();
+	mImageList.clear();
+	TexturePool::Get().Clear();
+}
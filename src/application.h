@@ -0,0 +1,205 @@
+#ifndef _APPLICATION_H_
+#define _APPLICATION_H_
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "utils.h"
+#include "ref.h"
+#include "texture.h"
+#include "frame.h"
+#include "tiles.h"
+#include "metadata.h"
+#include "watcher.h"
+#include "jobs.h"
+#include "grid.h"
+
+class ImageInfo
+{
+public:
+	ImageInfo(std::string _path);
+
+	// Decode the thumbnail on a worker and upload it on the main thread.
+	// Jobs only hold a weak reference, the last owner of an ImageInfo (and of its texture) stays on the main thread.
+	static void LoadThumbnail(const Ref<ImageInfo> &image, const CancelToken &token);
+
+	void Release()
+	{
+		mTexture.Release();
+	}
+
+public:
+	std::string GetPath() { return mPath; }
+	const Texture2D &GetTexture() { return mTexture; }
+	int GetWidth() { return mWidth; }
+	int GetHeight() { return mHeight; }
+	int GetOrientation() { return mOrientation; }
+	std::string GetName()
+	{
+		std::string name = mPath;
+		return name.substr(name.find_last_of("\\/") + 1);
+	}
+
+private:
+	void SetThumbnail(const cv::Mat &img, cv::Size size);
+
+	std::string mPath = "";
+	ImageHeader mHeader;
+	bool mProbed = false;
+	int mWidth;
+	int mHeight;
+	int mOrientation = 1;
+	Texture2D mTexture;
+};
+
+// A decoded source and its reduced copy for the drafts composed while settings are dragged.
+struct DecodedImage
+{
+	cv::Mat image;
+	cv::Mat draft;
+};
+
+// Exports still queued or running, shared with their jobs so two exports never
+// write the same file or the same manifest at once.
+struct ExportRegistry
+{
+	std::mutex mutex;
+	std::unordered_set<std::string> folders; // of Save All
+	std::unordered_set<std::string> files;	 // of Save As
+};
+
+class Application
+{
+public:
+	Application() : mTexture{}
+	{
+	}
+
+	// Everything the application does in one frame of Window::run.
+	void Frame();
+
+	void MenuBarFunction();
+
+	void ViewFunction();
+
+	void OpenFiles(const std::vector<std::string> &paths);
+
+	// List the images of folder and watch it for changes.
+	void OpenFolder(const std::string &folder);
+
+	// Save As and Save All run as batch jobs, a second export to a file or folder
+	// still being written is refused.
+	void SaveFile(std::string path);
+
+	void SaveFolder(std::string folderPath);
+
+	FrameSettings GetFrameSettings();
+
+	// Same as editing the Setting panel.
+	void SetFrameSettings(const FrameSettings &settings);
+
+	int GetImageCount() const { return (int)mImageList.size(); }
+
+	// Same as clicking a thumbnail of the strip.
+	void SelectImage(int index);
+
+	// Scroll position of the strip applied on the next frame.
+	void SetStripScroll(float scroll) { mStripScroll = scroll; }
+
+	// No job queued or running for the UI and the image on screen is composed.
+	bool IsIdle() const;
+
+	void Inspection();
+
+	// Compose a quick low resolution preview of the current settings on the main thread.
+	void ComposeDraft();
+
+	// Compose the full quality preview in an interactive job and swap it in when done.
+	void RefinePreview();
+
+	void SetPreview(const cv::Mat &preview);
+
+	Ref<ImageInfo> CreateImage(const std::string &path);
+
+	// Cancel the thumbnail and prefetch jobs of the previous list before dropping it.
+	void ClearImages();
+
+	// Show the image at index, decoded by an interactive job unless it was prefetched.
+	// The previous frame stays on screen until the new image arrives.
+	void LoadCurrentImage(int index);
+
+	void SetCurrentImage(const std::string &path, const DecodedImage &decoded, int orientation);
+
+	// Decode the neighbours of index in the background, only they and the current image stay cached.
+	void Prefetch(int index);
+
+	// Apply the changes of the opened folder to the image list, one entry per file.
+	void WatchFolder();
+
+	float GetViewZoom()
+	{
+		return mZoom > 0.0f ? mZoom : mFitZoom;
+	}
+
+	void DrawTiles(ImDrawList *draw_list, ImVec2 origin, float zoom, ImVec2 clipPos, ImVec2 clipSize);
+
+	// Every image of the list framed with the current settings, in the View pane.
+	// Click selects, double click opens the image in the single view.
+	void DrawGrid();
+
+	void AcquirePreviewTexture(cv::Size size);
+
+	void Reset();
+
+	~Application();
+
+public:
+	bool exit_app = false;
+
+private:
+	std::string mCurrentImagePath{};
+	std::string mFolderPath{};
+	std::string mSaveFolderPath{};
+	float mWidth = 6;
+	float mHeight = 9;
+	float mBorderOfset = 0.25;
+	float mBottomOfset = 0.75;
+	int mPPI = DEFAULT_PPI;
+	bool mAutoOrient = true;
+	ImVec4 mBgColor = {1.0f, 1.0f, 1.0f, 1.0f};
+	ImVec4 mBorderColor = {1.0f, 1.0f, 1.0f, 1.0f};
+	std::vector<Ref<ImageInfo>> mImageList{};
+	int mCurrentIdex = 0;
+	int mPreviousIdex = 0;
+	int mLoadedIdex = -1; // -1 when the list is empty
+	cv::Mat mCurrentMat;
+	cv::Mat mDraftMat; // mCurrentMat reduced to about twice kDraftMaxSide
+	std::string mCurrentPath{};
+	int mCurrentOrientation = 1;
+	CancelToken mListToken;	// thumbnails and prefetch of the current list
+	CancelToken mLoadToken;	// decode of the current image
+	std::unordered_map<std::string, DecodedImage> mPrefetched{};
+	std::unordered_set<std::string> mPrefetching{};
+	Texture2D mTexture;
+	FrameSettings mFrameSettings{};
+	FrameLayout mLayout{};
+	bool mFrameDirty = true;
+	double mPreviewScale = 1.0;
+	bool mPreviewDraft = false;	// the texture holds the draft, the refined preview is pending
+	bool mRefineQueued = false;
+	CancelToken mComposeToken;	// refine of the preview for the current settings
+	std::chrono::steady_clock::time_point mLastEdit{};
+	float mZoom = 0.0f; // display pixels per print pixel, 0 = fit to the pane
+	float mFitZoom = 0.0f;
+	ImVec2 mPan{};		// print pixel shown at the center of the pane
+	float mStripScroll = -1.0f; // pending strip scroll, negative when none
+	TileCache mTiles;
+	bool mGridView = false;
+	float mGridCell = 200.0f; // side of a grid cell in pixels
+	ContactGrid mGrid;
+	FolderWatcher mWatcher;
+	std::shared_ptr<ExportRegistry> mExports = std::make_shared<ExportRegistry>();
+};
+#endif
@@ -0,0 +1,362 @@
+#include "daemon.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include "exporter.h"
+#include "metadata.h"
+#include "logger.h"
+#include "utils.h"
+
+static const std::chrono::milliseconds kPollInterval(10);
+// files closed after writing are taken at once, others once their size stopped changing
+static const std::chrono::milliseconds kSettle(500);
+static const std::chrono::milliseconds kCloseSettle(0);
+static const std::chrono::seconds kStatusPeriod(1);
+static const size_t kLatencySamples = 1024;
+// prefix of the file being encoded, renamed to the output name once complete
+static const char *kPartialPrefix = ".partial-";
+
+static std::atomic<bool> sStop{false};
+
+// hidden files are the temporaries of copy tools (rsync, browsers), they are renamed once complete
+static bool IsCandidate(const std::string &path)
+{
+	std::string name = std::filesystem::path(path).filename().string();
+	return !name.empty() && name[0] != '.' && IsImageFile(name);
+}
+
+static double Percentile(std::vector<double> values, double p)
+{
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, (size_t)(p * (values.size() - 1) + 0.5))];
+}
+
+static std::string JsonString(const std::string &text)
+{
+	std::string out = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		if ((unsigned char)c < 0x20)
+			continue;
+		out += c;
+	}
+	return out + "\"";
+}
+
+HotFolder::HotFolder(const DaemonOptions &options)
+	: mOptions(options), mManifest(options.output)
+{
+	if (mOptions.status.empty())
+		mOptions.status = (std::filesystem::path(mOptions.output) / DAEMON_STATUS_NAME).string();
+	mSettingsHash = HashFrameSettings(mOptions.settings);
+	mLatencies.reserve(kLatencySamples);
+}
+
+int HotFolder::Run(const std::atomic<bool> &stop)
+{
+	std::error_code error;
+	std::filesystem::create_directories(mOptions.output, error);
+	// photos that landed while the daemon was not running, one may still be being copied so the
+	// watcher reports them once their size settled, the manifest skips those already framed
+	if (!error)
+	{
+		for (const auto &entry : std::filesystem::directory_iterator(mOptions.input, error))
+		{
+			if (entry.is_regular_file(error) && IsCandidate(entry.path().string()))
+				mBacklog.insert(entry.path().string());
+		}
+	}
+	if (error || !mWatcher.Open(mOptions.input, true))
+	{
+		LOG_ERROR("Cannot watch %s or write to %s", mOptions.input.c_str(), mOptions.output.c_str());
+		return 1;
+	}
+	mStart = Clock::now();
+	mManifest.Load();
+	LOG_INFO("Watching %s, framed photos go to %s", mOptions.input.c_str(), mOptions.output.c_str());
+
+	Clock::time_point lastStatus{};
+	while (!stop)
+	{
+		for (const auto &event : mWatcher.Poll(kSettle, kCloseSettle))
+		{
+			bool backlog = mBacklog.erase(event.path) > 0;
+			if (event.change != FolderWatcher::Change::Removed && IsCandidate(event.path))
+				Enqueue(event.path, backlog ? JobPriority::Batch : JobPriority::Interactive, event.seen);
+		}
+		if (Clock::now() - lastStatus >= kStatusPeriod)
+		{
+			WriteStatus();
+			lastStatus = Clock::now();
+		}
+		std::this_thread::sleep_for(kPollInterval);
+	}
+
+	LOG_INFO("Stopping, finishing the queued photos");
+	for (;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (!mPending)
+				break;
+		}
+		std::this_thread::sleep_for(kPollInterval);
+	}
+	mWatcher.Close();
+	WriteStatus();
+	return 0;
+}
+
+void HotFolder::Enqueue(const std::string &path, JobPriority priority, Clock::time_point landed)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		// two jobs never write the same output
+		if (mRunning.count(path))
+		{
+			mAgain.insert(path);
+			return;
+		}
+		if (!mQueued.insert(path).second)
+			return;
+		mPending++;
+	}
+	JobSystem::Get().Submit(priority, [this, path, landed]() { Process(path, landed); });
+}
+
+void HotFolder::Process(const std::string &path, Clock::time_point landed)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueued.erase(path);
+		mRunning.insert(path);
+	}
+	Outcome outcome = Frame(path);
+	Clock::time_point done = Clock::now();
+	double latency = std::chrono::duration<double, std::milli>(done - landed).count();
+
+	bool again;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		Account(path, outcome, done, latency);
+		mRunning.erase(path);
+		again = mAgain.erase(path) > 0;
+	}
+	// the new content landed while the previous one was being framed, it is counted from now
+	if (again)
+		Enqueue(path, JobPriority::Interactive, Clock::now());
+	// only now, Run must not return while a job is about to queue again
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPending--;
+}
+
+void HotFolder::Account(const std::string &path, Outcome outcome, Clock::time_point done, double latency)
+{
+	switch (outcome)
+	{
+	case Outcome::Framed:
+		mFramed++;
+		mLast = path;
+		if (mLatencies.size() < kLatencySamples)
+			mLatencies.push_back(latency);
+		else
+			mLatencies[mLatencyNext] = latency;
+		mLatencyNext = (mLatencyNext + 1) % kLatencySamples;
+		mRecent.push_back(done);
+		LOG_INFO("Framed %s in %.0f ms", path.c_str(), latency);
+		break;
+	case Outcome::Skipped:
+		mSkipped++;
+		break;
+	case Outcome::Failed:
+		mFailed++;
+		break;
+	}
+}
+
+HotFolder::Outcome HotFolder::Frame(const std::string &path)
+{
+	std::string name = std::filesystem::path(path).filename().string();
+	ManifestEntry entry;
+	if (!ExportManifest::Describe(path, name, mSettingsHash, entry))
+	{
+		LOG_WARN("%s disappeared before it was framed", path.c_str());
+		return Outcome::Failed;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mManifest.IsUpToDate(entry))
+			return Outcome::Skipped;
+	}
+
+	cv::Mat image = LoadSource(path);
+	if (image.empty())
+	{
+		LOG_ERROR("Cannot decode %s", path.c_str());
+		return Outcome::Failed;
+	}
+	ImageHeader header;
+	int orientation = ProbeImageHeader(path, header) ? header.orientation : 1;
+	FrameLayout layout = MakeFrameLayout(mOptions.settings, image.size(), orientation);
+
+	// encoded under a hidden name and renamed, whatever watches the output never sees half a file
+	std::filesystem::path output = std::filesystem::path(mOptions.output) / name;
+	std::filesystem::path partial = std::filesystem::path(mOptions.output) / (kPartialPrefix + name);
+	std::error_code error;
+	if (!ExportFrame(image, layout, partial.string()))
+	{
+		LOG_ERROR("Export failed: %s", path.c_str());
+		std::filesystem::remove(partial, error);
+		return Outcome::Failed;
+	}
+	std::filesystem::rename(partial, output, error);
+	if (error)
+	{
+		LOG_ERROR("Cannot write %s: %s", output.string().c_str(), error.message().c_str());
+		std::filesystem::remove(partial, error);
+		return Outcome::Failed;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mManifest.Update(entry);
+	mManifestDirty = true;
+	return Outcome::Framed;
+}
+
+bool HotFolder::WriteStatus()
+{
+	Clock::time_point now = Clock::now();
+	std::vector<double> latencies;
+	size_t framed, skipped, failed, recent;
+	int pending;
+	std::string last;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		while (!mRecent.empty() && now - mRecent.front() > std::chrono::minutes(1))
+			mRecent.pop_front();
+		latencies = mLatencies;
+		framed = mFramed;
+		skipped = mSkipped;
+		failed = mFailed;
+		recent = mRecent.size();
+		pending = mPending;
+		last = mLast;
+	}
+
+	// the manifest is saved with the status, a crash costs at most a second of re-framing
+	bool saveManifest = false;
+	ExportManifest manifest(mOptions.output);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mManifestDirty)
+		{
+			manifest = mManifest;
+			mManifestDirty = false;
+			saveManifest = true;
+		}
+	}
+	if (saveManifest && !manifest.Save())
+		LOG_WARN("Cannot write the export manifest of %s", mOptions.output.c_str());
+
+	double uptime = std::chrono::duration<double>(now - mStart).count();
+	double max = latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end());
+	std::filesystem::path path = mOptions.status;
+	std::filesystem::path temp = path;
+	temp += ".tmp";
+	{
+		FILE *file = fopen(temp.string().c_str(), "w");
+		if (!file)
+			return false;
+		fprintf(file, "{\n  \"input\": %s,\n  \"output\": %s,\n  \"uptime_s\": %.1f,\n", JsonString(mOptions.input).c_str(), JsonString(mOptions.output).c_str(), uptime);
+		fprintf(file, "  \"framed\": %zu,\n  \"skipped\": %zu,\n  \"failed\": %zu,\n  \"pending\": %d,\n", framed, skipped, failed, pending);
+		fprintf(file, "  \"per_minute\": %zu,\n  \"per_minute_average\": %.1f,\n", recent, uptime > 0.0 ? framed * 60.0 / uptime : 0.0);
+		fprintf(file, "  \"latency_ms\": {\"samples\": %zu, \"p50\": %.1f, \"p95\": %.1f, \"p99\": %.1f, \"max\": %.1f},\n",
+				latencies.size(), Percentile(latencies, 0.50), Percentile(latencies, 0.95), Percentile(latencies, 0.99), max);
+		fprintf(file, "  \"last\": %s\n}\n", JsonString(last).c_str());
+		if (fclose(file) != 0)
+			return false;
+	}
+	std::error_code error;
+	std::filesystem::rename(temp, path, error);
+	return !error;
+}
+
+static void PrintUsage(const char *program)
+{
+	fprintf(stderr,
+			"usage: %s --daemon <input folder> <output folder> [options]\n"
+			"  --status file.json   status file (default: <output>/" DAEMON_STATUS_NAME ")\n"
+			"  --log file           log file (default: stderr)\n"
+			"  --size WxH           frame size in cm (default: 6x9)\n"
+			"  --border cm          border width (default: 0.25)\n"
+			"  --bottom cm          extra bottom border (default: 0.75)\n"
+			"  --ppi N              print resolution (default: %d)\n",
+			program, DEFAULT_PPI);
+}
+
+static bool ParseOptions(int argc, char **argv, DaemonOptions &options)
+{
+	if (argc < 4 || strcmp(argv[1], "--daemon"))
+		return false;
+	options.input = argv[2];
+	options.output = argv[3];
+	for (int i = 4; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--status") && hasValue)
+			options.status = argv[++i];
+		else if (!strcmp(argv[i], "--log") && hasValue)
+			options.log = argv[++i];
+		else if (!strcmp(argv[i], "--size") && hasValue && sscanf(argv[++i], "%fx%f", &options.settings.width, &options.settings.height) == 2)
+			continue;
+		else if (!strcmp(argv[i], "--border") && hasValue)
+			options.settings.borderOffset = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--bottom") && hasValue)
+			options.settings.bottomOffset = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--ppi") && hasValue)
+			options.settings.ppi = std::max(1, atoi(argv[++i]));
+		else
+			return false;
+	}
+	return true;
+}
+
+int RunDaemon(int argc, char **argv)
+{
+	DaemonOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	std::error_code error;
+	if (std::filesystem::equivalent(options.input, options.output, error))
+	{
+		// the outputs would be framed again
+		fprintf(stderr, "the output folder must differ from the input folder\n");
+		return 1;
+	}
+	if (!options.log.empty() && !Logger::Get().Open(options.log))
+	{
+		fprintf(stderr, "cannot write %s\n", options.log.c_str());
+		return 1;
+	}
+	if (MakeFrameLayout(options.settings, cv::Size(3, 2)).borderRect.empty())
+	{
+		LOG_ERROR("Invalid frame settings");
+		return 1;
+	}
+
+	std::signal(SIGINT, [](int) { sStop = true; });
+	std::signal(SIGTERM, [](int) { sStop = true; });
+	HotFolder folder(options);
+	return folder.Run(sStop);
+}
@@ -0,0 +1,84 @@
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "frame.h"
+#include "manifest.h"
+#include "watcher.h"
+#include "jobs.h"
+
+// Name of the status file written in the output folder unless --status is given.
+#define DAEMON_STATUS_NAME "polaroid-status.json"
+
+struct DaemonOptions
+{
+	std::string input;
+	std::string output;
+	std::string status; // status JSON, DAEMON_STATUS_NAME in output when empty
+	std::string log;	// log file, stderr when empty
+	FrameSettings settings;
+};
+
+// Hot folder: every image that lands in the input folder is framed and written
+// to the output folder under the same name, the way Save All would.
+// Files are picked up as soon as the watcher sees them closed after writing,
+// framed by interactive jobs so a new photo never waits behind the backlog
+// found at startup, and renamed into place only once complete.
+// Latency (landing to framed output) and throughput go to a JSON status file.
+class HotFolder
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit HotFolder(const DaemonOptions &options);
+
+	// Blocks until stop is set, then finishes the queued images.
+	// Returns non-zero when the folders cannot be opened.
+	int Run(const std::atomic<bool> &stop);
+
+private:
+	enum class Outcome
+	{
+		Framed,
+		Skipped,
+		Failed
+	};
+
+	// landed is when the watcher first saw the file, latencies are measured from it.
+	void Enqueue(const std::string &path, JobPriority priority, Clock::time_point landed);
+	void Process(const std::string &path, Clock::time_point landed);
+	Outcome Frame(const std::string &path);
+	// Statistics of a finished job, called with mMutex held.
+	void Account(const std::string &path, Outcome outcome, Clock::time_point done, double latency);
+	bool WriteStatus();
+
+	DaemonOptions mOptions;
+	uint64_t mSettingsHash = 0;
+	FolderWatcher mWatcher;
+	std::unordered_set<std::string> mBacklog; // found at startup, queued as batch once the watcher reports them
+	Clock::time_point mStart;
+
+	std::mutex mMutex; // everything below
+	ExportManifest mManifest;
+	bool mManifestDirty = false;
+	std::unordered_set<std::string> mQueued;  // waiting for a worker, a second event for them is dropped
+	std::unordered_set<std::string> mRunning; // being framed
+	std::unordered_set<std::string> mAgain;	  // changed while being framed, queued again once done
+	int mPending = 0;						 // queued or running
+	size_t mFramed = 0;
+	size_t mSkipped = 0;
+	size_t mFailed = 0;
+	std::string mLast;
+	std::vector<double> mLatencies;			 // milliseconds, ring of the last kLatencySamples
+	size_t mLatencyNext = 0;
+	std::deque<Clock::time_point> mRecent;	 // completions of the last minute
+};
+
+// `polaroid --daemon <input> <output> [options]`, see the usage text.
+int RunDaemon(int argc, char **argv);
+#endif
@@ -0,0 +1,440 @@
+#include "exporter.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "opencv2/imgcodecs.hpp"
+#ifdef POLAROID_WITH_PNG
+#include <png.h>
+#endif
+#ifdef POLAROID_WITH_JPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+static std::string LowerExtension(const std::string &path)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos)
+		return "";
+	std::string ext = path.substr(dot);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return ext;
+}
+
+// Uncompressed baseline TIFF, switching to BigTIFF past 4 GB.
+// Pixel data is written right after the header, the strip tables and the IFD
+// are appended once every row is known.
+class TiffWriter : public ScanlineWriter
+{
+public:
+	TiffWriter(const std::string &path, cv::Size size, int type, int ppi)
+		: mSize(size), mType(type), mPpi(ppi)
+	{
+		mRowBytes = (uint64_t)size.width * CV_ELEM_SIZE(type);
+		mBig = mRowBytes * size.height + (1u << 20) > 0xFFFFFFFFull;
+		mFile.open(path, std::ios::binary | std::ios::trunc);
+
+		std::vector<uint8_t> header;
+		header.push_back('I');
+		header.push_back('I');
+		if (mBig)
+		{
+			Put(header, 43, 2);
+			Put(header, 8, 2);
+			Put(header, 0, 2);
+			Put(header, 0, 8); // IFD offset, patched by Finish
+		}
+		else
+		{
+			Put(header, 42, 2);
+			Put(header, 0, 4);
+		}
+		mDataOffset = header.size();
+		mFile.write((const char *)header.data(), header.size());
+	}
+
+	bool Write(const cv::Mat &band) override
+	{
+		if (!mFile || band.cols != mSize.width || band.type() != mType || mRows + band.rows > mSize.height)
+			return false;
+
+		// TIFF stores RGB, bands are BGR
+		cv::cvtColor(band, mRgb, cv::COLOR_BGR2RGB);
+		for (int r = 0; r < mRgb.rows; r++)
+			mFile.write((const char *)mRgb.ptr(r), mRowBytes);
+		mRows += band.rows;
+		return (bool)mFile;
+	}
+
+	bool Finish() override
+	{
+		if (!mFile || mRows != mSize.height)
+			return false;
+
+		const int rowsPerStrip = 16;
+		uint64_t strips = (mSize.height + rowsPerStrip - 1) / rowsPerStrip;
+		std::vector<uint64_t> offsets(strips), counts(strips);
+		for (uint64_t i = 0; i < strips; i++)
+		{
+			uint64_t rows = std::min<uint64_t>(rowsPerStrip, mSize.height - i * rowsPerStrip);
+			offsets[i] = mDataOffset + i * rowsPerStrip * mRowBytes;
+			counts[i] = rows * mRowBytes;
+		}
+
+		uint16_t bits = (uint16_t)(CV_ELEM_SIZE1(mType) * 8);
+		uint16_t channels = (uint16_t)CV_MAT_CN(mType);
+		std::vector<Entry> entries;
+		AddValues(entries, 256, {(uint64_t)mSize.width}, 4);
+		AddValues(entries, 257, {(uint64_t)mSize.height}, 4);
+		AddValues(entries, 258, std::vector<uint64_t>(channels, bits), 3);
+		AddValues(entries, 259, {1}, 3);	 // no compression
+		AddValues(entries, 262, {2}, 3);	 // RGB
+		AddValues(entries, 273, offsets, mBig ? 16 : 4);
+		AddValues(entries, 277, {channels}, 3);
+		AddValues(entries, 278, {(uint64_t)rowsPerStrip}, 4);
+		AddValues(entries, 279, counts, mBig ? 16 : 4);
+		AddRational(entries, 282, mPpi);
+		AddRational(entries, 283, mPpi);
+		AddValues(entries, 284, {1}, 3);	 // chunky
+		AddValues(entries, 296, {2}, 3);	 // inch
+
+		// values that do not fit in an entry go before the IFD
+		const size_t inlineBytes = mBig ? 8 : 4;
+		uint64_t offset = mDataOffset + mRowBytes * mSize.height;
+		std::vector<uint8_t> blob;
+		for (auto &entry : entries)
+		{
+			if (entry.data.size() > inlineBytes)
+			{
+				if ((offset + blob.size()) & 1)
+					blob.push_back(0);
+				entry.offset = offset + blob.size();
+				blob.insert(blob.end(), entry.data.begin(), entry.data.end());
+			}
+		}
+		if ((offset + blob.size()) & 1)
+			blob.push_back(0);
+		uint64_t ifdOffset = offset + blob.size();
+
+		std::vector<uint8_t> ifd;
+		Put(ifd, entries.size(), mBig ? 8 : 2);
+		for (auto &entry : entries)
+		{
+			Put(ifd, entry.tag, 2);
+			Put(ifd, entry.type, 2);
+			Put(ifd, entry.count, mBig ? 8 : 4);
+			if (entry.data.size() > inlineBytes)
+			{
+				Put(ifd, entry.offset, inlineBytes);
+			}
+			else
+			{
+				std::vector<uint8_t> value = entry.data;
+				value.resize(inlineBytes, 0);
+				ifd.insert(ifd.end(), value.begin(), value.end());
+			}
+		}
+		Put(ifd, 0, mBig ? 8 : 4); // no next IFD
+
+		mFile.write((const char *)blob.data(), blob.size());
+		mFile.write((const char *)ifd.data(), ifd.size());
+
+		std::vector<uint8_t> patch;
+		Put(patch, ifdOffset, mBig ? 8 : 4);
+		mFile.seekp(mBig ? 8 : 4);
+		mFile.write((const char *)patch.data(), patch.size());
+		mFile.close();
+		return !mFile.fail();
+	}
+
+private:
+	struct Entry
+	{
+		uint16_t tag;
+		uint16_t type;
+		uint64_t count;
+		std::vector<uint8_t> data;
+		uint64_t offset = 0;
+	};
+
+	static void Put(std::vector<uint8_t> &out, uint64_t value, size_t bytes)
+	{
+		for (size_t i = 0; i < bytes; i++)
+			out.push_back((uint8_t)(value >> (8 * i)));
+	}
+
+	// type 3 = SHORT, 4 = LONG, 16 = LONG8
+	static void AddValues(std::vector<Entry> &entries, uint16_t tag, const std::vector<uint64_t> &values, uint16_t type)
+	{
+		Entry entry{tag, type, values.size(), {}};
+		size_t bytes = type == 3 ? 2 : type == 4 ? 4 : 8;
+		for (uint64_t value : values)
+			Put(entry.data, value, bytes);
+		entries.push_back(std::move(entry));
+	}
+
+	static void AddRational(std::vector<Entry> &entries, uint16_t tag, int value)
+	{
+		Entry entry{tag, 5, 1, {}};
+		Put(entry.data, (uint32_t)value, 4);
+		Put(entry.data, 1, 4);
+		entries.push_back(std::move(entry));
+	}
+
+	std::ofstream mFile;
+	cv::Size mSize;
+	int mType;
+	int mPpi;
+	bool mBig = false;
+	uint64_t mRowBytes = 0;
+	uint64_t mDataOffset = 0;
+	int mRows = 0;
+	cv::Mat mRgb;
+};
+
+#ifdef POLAROID_WITH_PNG
+class PngWriter : public ScanlineWriter
+{
+public:
+	PngWriter(const std::string &path, cv::Size size, int type, int ppi)
+		: mSize(size), mType(type)
+	{
+		mFile = fopen(path.c_str(), "wb");
+		if (!mFile)
+			return;
+		mPng = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+		mInfo = mPng ? png_create_info_struct(mPng) : nullptr;
+		if (!mInfo || setjmp(png_jmpbuf(mPng)))
+		{
+			mFailed = true;
+			return;
+		}
+		png_init_io(mPng, mFile);
+		png_set_IHDR(mPng, mInfo, size.width, size.height, (int)CV_ELEM_SIZE1(type) * 8, PNG_COLOR_TYPE_RGB,
+					 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_uint_32 ppm = (png_uint_32)(ppi / 0.0254 + 0.5);
+		png_set_pHYs(mPng, mInfo, ppm, ppm, PNG_RESOLUTION_METER);
+		png_set_compression_level(mPng, 3);
+		png_write_info(mPng, mInfo);
+		png_set_bgr(mPng);
+		if (CV_MAT_DEPTH(type) == CV_16U)
+			png_set_swap(mPng); // cv::Mat holds native little endian samples
+	}
+
+	~PngWriter() override
+	{
+		if (mPng)
+			png_destroy_write_struct(&mPng, &mInfo);
+		if (mFile)
+			fclose(mFile);
+	}
+
+	bool Write(const cv::Mat &band) override
+	{
+		if (!mFile || mFailed || band.cols != mSize.width || band.type() != mType)
+			return false;
+		if (setjmp(png_jmpbuf(mPng)))
+		{
+			mFailed = true;
+			return false;
+		}
+		for (int r = 0; r < band.rows; r++)
+			png_write_row(mPng, (png_const_bytep)band.ptr(r));
+		return true;
+	}
+
+	bool Finish() override
+	{
+		if (!mFile || mFailed)
+			return false;
+		if (setjmp(png_jmpbuf(mPng)))
+		{
+			mFailed = true;
+			return false;
+		}
+		png_write_end(mPng, mInfo);
+		return fflush(mFile) == 0;
+	}
+
+private:
+	FILE *mFile = nullptr;
+	png_structp mPng = nullptr;
+	png_infop mInfo = nullptr;
+	cv::Size mSize;
+	int mType;
+	bool mFailed = false;
+};
+#endif
+
+#ifdef POLAROID_WITH_JPEG
+class JpegWriter : public ScanlineWriter
+{
+public:
+	JpegWriter(const std::string &path, cv::Size size, int type, int ppi)
+		: mSize(size), mType(type)
+	{
+		mFile = fopen(path.c_str(), "wb");
+		if (!mFile)
+			return;
+		mInfo.err = jpeg_std_error(&mError.base);
+		mError.base.error_exit = [](j_common_ptr info) { longjmp(((Error *)info->err)->jump, 1); };
+		if (setjmp(mError.jump))
+		{
+			mFailed = true;
+			return;
+		}
+		jpeg_create_compress(&mInfo);
+		mCreated = true;
+		jpeg_stdio_dest(&mInfo, mFile);
+		mInfo.image_width = size.width;
+		mInfo.image_height = size.height;
+		mInfo.input_components = 3;
+		mInfo.in_color_space = JCS_RGB;
+		jpeg_set_defaults(&mInfo);
+		jpeg_set_quality(&mInfo, 95, TRUE);
+		mInfo.density_unit = 1; // dots per inch
+		mInfo.X_density = (UINT16)ppi;
+		mInfo.Y_density = (UINT16)ppi;
+		jpeg_start_compress(&mInfo, TRUE);
+	}
+
+	~JpegWriter() override
+	{
+		if (mCreated)
+			jpeg_destroy_compress(&mInfo);
+		if (mFile)
+			fclose(mFile);
+	}
+
+	bool Write(const cv::Mat &band) override
+	{
+		if (!mFile || mFailed || band.cols != mSize.width || band.type() != mType)
+			return false;
+
+		// JPEG is 8-bit RGB only
+		const cv::Mat *input = &band;
+		if (band.depth() != CV_8U)
+		{
+			band.convertTo(mDepth, CV_8U, 1.0 / 257.0);
+			input = &mDepth;
+		}
+		cv::cvtColor(*input, mRgb, cv::COLOR_BGR2RGB);
+
+		if (setjmp(mError.jump))
+		{
+			mFailed = true;
+			return false;
+		}
+		for (int r = 0; r < mRgb.rows; r++)
+		{
+			JSAMPROW row = mRgb.ptr(r);
+			jpeg_write_scanlines(&mInfo, &row, 1);
+		}
+		return true;
+	}
+
+	bool Finish() override
+	{
+		if (!mFile || mFailed)
+			return false;
+		if (setjmp(mError.jump))
+		{
+			mFailed = true;
+			return false;
+		}
+		jpeg_finish_compress(&mInfo);
+		return fflush(mFile) == 0;
+	}
+
+private:
+	struct Error
+	{
+		jpeg_error_mgr base;
+		jmp_buf jump;
+	};
+
+	FILE *mFile = nullptr;
+	jpeg_compress_struct mInfo{};
+	Error mError{};
+	cv::Size mSize;
+	int mType;
+	bool mCreated = false;
+	bool mFailed = false;
+	cv::Mat mDepth;
+	cv::Mat mRgb;
+};
+#endif
+
+// Formats without a streaming encoder: assemble the image and hand it to imwrite.
+class BufferedWriter : public ScanlineWriter
+{
+public:
+	BufferedWriter(const std::string &path, cv::Size size, int type)
+		: mPath(path), mImage(size, type), mRows(0)
+	{
+	}
+
+	bool Write(const cv::Mat &band) override
+	{
+		if (band.cols != mImage.cols || band.type() != mImage.type() || mRows + band.rows > mImage.rows)
+			return false;
+		band.copyTo(mImage.rowRange(mRows, mRows + band.rows));
+		mRows += band.rows;
+		return true;
+	}
+
+	bool Finish() override
+	{
+		return mRows == mImage.rows && cv::imwrite(mPath, mImage);
+	}
+
+private:
+	std::string mPath;
+	cv::Mat mImage;
+	int mRows;
+};
+
+Scope<ScanlineWriter> ScanlineWriter::Create(const std::string &path, cv::Size size, int type, int ppi)
+{
+	std::string ext = LowerExtension(path);
+	if (ext == ".tif" || ext == ".tiff")
+		return CreateScope<TiffWriter>(path, size, type, ppi);
+#ifdef POLAROID_WITH_PNG
+	if (ext == ".png")
+		return CreateScope<PngWriter>(path, size, type, ppi);
+#endif
+#ifdef POLAROID_WITH_JPEG
+	if (ext == ".jpg" || ext == ".jpeg")
+		return CreateScope<JpegWriter>(path, size, type, ppi);
+#endif
+	return CreateScope<BufferedWriter>(path, size, type);
+}
+
+bool ScanlineWriter::SupportsDepth(const std::string &path, int depth)
+{
+	if (depth == CV_8U)
+		return true;
+	std::string ext = LowerExtension(path);
+	return depth == CV_16U && (ext == ".tif" || ext == ".tiff" || ext == ".png");
+}
+
+bool ExportFrame(const cv::Mat &src, const FrameLayout &layout, const std::string &path, int interpolation)
+{
+	if (layout.borderRect.empty())
+		return false;
+
+	int depth = src.depth() == CV_16U && ScanlineWriter::SupportsDepth(path, CV_16U) ? CV_16U : CV_8U;
+	Scope<ScanlineWriter> writer = ScanlineWriter::Create(path, layout.size, CV_MAKETYPE(depth, 3), layout.ppi);
+	cv::Mat band;
+	for (int y = 0; y < layout.size.height; y += EXPORT_BAND_ROWS)
+	{
+		cv::Rect region(0, y, layout.size.width, std::min(EXPORT_BAND_ROWS, layout.size.height - y));
+		ComposeRegion(src, layout, region, 1.0, interpolation, band, depth);
+		if (!writer->Write(band))
+			return false;
+	}
+	return writer->Finish();
+}
@@ -0,0 +1,35 @@
+#ifndef _EXPORTER_H_
+#define _EXPORTER_H_
+#include <string>
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "frame.h"
+#include "ref.h"
+
+// Rows per band when a frame is composed and encoded in horizontal strips.
+#define EXPORT_BAND_ROWS 256
+
+// Encoder fed with horizontal bands of a BGR image, top to bottom.
+// Peak memory is a band plus the encoder state, whatever the image size.
+class ScanlineWriter
+{
+public:
+	virtual ~ScanlineWriter() = default;
+
+	// band.cols must be the image width, rows are appended after the previous band.
+	virtual bool Write(const cv::Mat &band) = 0;
+	// Flush the file once every row has been written.
+	virtual bool Finish() = 0;
+
+	// Pick an encoder from the file extension: .tif/.tiff are always streamed,
+	// .png/.jpg are streamed when libpng/libjpeg are available and buffered otherwise.
+	static Scope<ScanlineWriter> Create(const std::string &path, cv::Size size, int type, int ppi);
+
+	// Whether the format picked for path stores samples of the given depth, TIFF and PNG keep 16 bit.
+	static bool SupportsDepth(const std::string &path, int depth);
+};
+
+// Compose the frame band by band and stream it to path.
+// 16-bit sources give 16-bit files when the format stores them.
+bool ExportFrame(const cv::Mat &src, const FrameLayout &layout, const std::string &path, int interpolation = cv::INTER_CUBIC);
+#endif
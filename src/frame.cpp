@@ -0,0 +1,362 @@
+#include "frame.h"
+#include "utils.h"
+#include "metadata.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/core/hal/intrin.hpp"
+
+static cv::Rect ScaleRect(const cv::Rect &rect, double scale)
+{
+	int x0 = cvRound(rect.x * scale);
+	int y0 = cvRound(rect.y * scale);
+	int x1 = cvRound((rect.x + rect.width) * scale);
+	int y1 = cvRound((rect.y + rect.height) * scale);
+	return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+// Inverse mapping: dst(u, v) = src(M * (u, v, 1)), M is axis aligned
+static void Resample(const cv::Mat &src, cv::Mat &dst, cv::Matx23d M, int interpolation)
+{
+	cv::Mat input = src;
+
+	// Sampling far below the source resolution aliases, area-average the source by an
+	// integer factor first. The reduction grid is anchored at the source origin so
+	// that neighbouring tiles and export bands shrink identically and stay seamless.
+	double stepX = std::abs(M(0, 0)) + std::abs(M(0, 1));
+	double stepY = std::abs(M(1, 0)) + std::abs(M(1, 1));
+	int kx = std::max(1, cvFloor(stepX));
+	int ky = std::max(1, cvFloor(stepY));
+	if (kx > 1 || ky > 1)
+	{
+		// source bounding box of the destination rectangle
+		double xa = M(0, 2);
+		double xb = M(0, 2) + M(0, 0) * (dst.cols - 1) + M(0, 1) * (dst.rows - 1);
+		double ya = M(1, 2);
+		double yb = M(1, 2) + M(1, 0) * (dst.cols - 1) + M(1, 1) * (dst.rows - 1);
+		int x0 = std::max(0, cvFloor(std::min(xa, xb)) - 2) / kx * kx;
+		int y0 = std::max(0, cvFloor(std::min(ya, yb)) - 2) / ky * ky;
+		int x1 = std::min(src.cols / kx * kx, (cvCeil(std::max(xa, xb)) + 2 + kx) / kx * kx);
+		int y1 = std::min(src.rows / ky * ky, (cvCeil(std::max(ya, yb)) + 2 + ky) / ky * ky);
+		if (x1 > x0 && y1 > y0)
+		{
+			cv::Mat roi = src(cv::Rect(x0, y0, x1 - x0, y1 - y0));
+			cv::resize(roi, input, cv::Size(roi.cols / kx, roi.rows / ky), 0, 0, cv::INTER_AREA);
+			M = cv::Matx23d(M(0, 0) / kx, M(0, 1) / kx, (M(0, 2) - x0 + 0.5) / kx - 0.5,
+							M(1, 0) / ky, M(1, 1) / ky, (M(1, 2) - y0 + 0.5) / ky - 0.5);
+		}
+	}
+
+	cv::warpAffine(input, dst, M, dst.size(), interpolation | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+}
+
+// Scale the colors by alpha, returns false when every pixel is opaque.
+template <typename T>
+static bool Premultiply(cv::Mat &image)
+{
+	const T opaque = std::numeric_limits<T>::max();
+	bool transparent = false;
+	for (int y = 0; y < image.rows; y++)
+	{
+		T *p = image.ptr<T>(y);
+		for (int x = 0; x < image.cols; x++, p += 4)
+		{
+			if (p[3] == opaque)
+				continue;
+			transparent = true;
+			float alpha = p[3] / (float)opaque;
+			for (int c = 0; c < 3; c++)
+				p[c] = (T)(p[c] * alpha + 0.5f);
+		}
+	}
+	return transparent;
+}
+
+#if CV_SIMD
+// CV_SIMD_WIDTH pixels as two halves of 16-bit lanes per channel
+template <int Cn>
+static inline void LoadPixels(const uchar *s, cv::v_uint16 lo[4], cv::v_uint16 hi[4])
+{
+	cv::v_uint8 c[4];
+	if constexpr (Cn == 4)
+		cv::v_load_deinterleave(s, c[0], c[1], c[2], c[3]);
+	else
+		cv::v_load_deinterleave(s, c[0], c[1], c[2]);
+	for (int i = 0; i < Cn; i++)
+		cv::v_expand(c[i], lo[i], hi[i]);
+}
+
+template <int Cn>
+static inline void LoadPixels(const ushort *s, cv::v_uint16 lo[4], cv::v_uint16 hi[4])
+{
+	const ushort *h = s + CV_SIMD_WIDTH / 2 * Cn;
+	if constexpr (Cn == 4)
+	{
+		cv::v_load_deinterleave(s, lo[0], lo[1], lo[2], lo[3]);
+		cv::v_load_deinterleave(h, hi[0], hi[1], hi[2], hi[3]);
+	}
+	else
+	{
+		cv::v_load_deinterleave(s, lo[0], lo[1], lo[2]);
+		cv::v_load_deinterleave(h, hi[0], hi[1], hi[2]);
+	}
+}
+
+static inline void StorePixels(uchar *d, const cv::v_uint16 lo[3], const cv::v_uint16 hi[3])
+{
+	cv::v_store_interleave(d, cv::v_pack(lo[0], hi[0]), cv::v_pack(lo[1], hi[1]), cv::v_pack(lo[2], hi[2]));
+}
+
+static inline void StorePixels(ushort *d, const cv::v_uint16 lo[3], const cv::v_uint16 hi[3])
+{
+	cv::v_store_interleave(d, lo[0], lo[1], lo[2]);
+	cv::v_store_interleave(d + CV_SIMD_WIDTH / 2 * 3, hi[0], hi[1], hi[2]);
+}
+
+static inline cv::v_float32 ToFloat(const cv::v_uint32 &v)
+{
+	return cv::v_cvt_f32(cv::v_reinterpret_as_s32(v));
+}
+
+// s * scale + alpha * bgAlpha + bgRound, truncated with saturation, the same arithmetic as the scalar loop
+static inline cv::v_uint16 Blend(const cv::v_uint16 &s, const cv::v_float32 &alpha0, const cv::v_float32 &alpha1,
+								 const cv::v_float32 &scale, const cv::v_float32 &bgAlpha, const cv::v_float32 &bgRound)
+{
+	cv::v_uint32 s0, s1;
+	cv::v_expand(s, s0, s1);
+	cv::v_float32 f0 = cv::v_muladd(ToFloat(s0), scale, cv::v_muladd(alpha0, bgAlpha, bgRound));
+	cv::v_float32 f1 = cv::v_muladd(ToFloat(s1), scale, cv::v_muladd(alpha1, bgAlpha, bgRound));
+	return cv::v_pack_u(cv::v_trunc(f0), cv::v_trunc(f1));
+}
+#endif
+
+// Resampled source (Cn = 3, or 4 with premultiplied alpha) to the BGR canvas.
+// Types are fixed at compile time. The inner loop runs on OpenCV universal intrinsics,
+// CV_SIMD_WIDTH pixels at a time, the tail of the row in scalar code; the resampling
+// itself is done by warpAffine's SIMD kernels.
+template <typename Src, int Cn, typename Dst>
+static void Composite(const cv::Mat &src, cv::Mat &dst, const cv::Scalar &background)
+{
+	constexpr float srcMax = (float)std::numeric_limits<Src>::max();
+	constexpr float dstMax = (float)std::numeric_limits<Dst>::max();
+	constexpr float scale = dstMax / srcMax;
+	// colors of the layout are 8-bit, the background shows through by 1 - alpha
+	float bgRound[3], bgAlpha[3];
+	for (int c = 0; c < 3; c++)
+	{
+		float bg = Cn == 4 ? (float)background[c] * (dstMax / 255.0f) : 0.0f;
+		bgRound[c] = bg + 0.5f;
+		bgAlpha[c] = -bg / srcMax;
+	}
+	for (int y = 0; y < src.rows; y++)
+	{
+		const Src *s = src.ptr<Src>(y);
+		Dst *d = dst.ptr<Dst>(y);
+		int x = 0;
+#if CV_SIMD
+		const cv::v_float32 vScale = cv::vx_setall_f32(scale);
+		const cv::v_float32 vBgAlpha[3] = {cv::vx_setall_f32(bgAlpha[0]), cv::vx_setall_f32(bgAlpha[1]), cv::vx_setall_f32(bgAlpha[2])};
+		const cv::v_float32 vBgRound[3] = {cv::vx_setall_f32(bgRound[0]), cv::vx_setall_f32(bgRound[1]), cv::vx_setall_f32(bgRound[2])};
+		for (; x <= src.cols - CV_SIMD_WIDTH; x += CV_SIMD_WIDTH)
+		{
+			cv::v_uint16 lo[4], hi[4];
+			LoadPixels<Cn>(s + x * Cn, lo, hi);
+			cv::v_float32 alpha[4];
+			if constexpr (Cn == 4)
+			{
+				cv::v_uint32 a0, a1;
+				cv::v_expand(lo[3], a0, a1);
+				alpha[0] = ToFloat(a0);
+				alpha[1] = ToFloat(a1);
+				cv::v_expand(hi[3], a0, a1);
+				alpha[2] = ToFloat(a0);
+				alpha[3] = ToFloat(a1);
+			}
+			else
+			{
+				alpha[0] = alpha[1] = alpha[2] = alpha[3] = cv::vx_setzero_f32();
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				lo[c] = Blend(lo[c], alpha[0], alpha[1], vScale, vBgAlpha[c], vBgRound[c]);
+				hi[c] = Blend(hi[c], alpha[2], alpha[3], vScale, vBgAlpha[c], vBgRound[c]);
+			}
+			StorePixels(d + x * 3, lo, hi);
+		}
+#endif
+		for (const Src *p = s + x * Cn; x < src.cols; x++, p += Cn)
+		{
+			float alpha = Cn == 4 ? (float)p[Cn - 1] : 0.0f;
+			for (int c = 0; c < 3; c++)
+				d[x * 3 + c] = (Dst)std::min(p[c] * scale + (alpha * bgAlpha[c] + bgRound[c]), dstMax);
+		}
+	}
+}
+
+typedef void (*CompositeFunc)(const cv::Mat &src, cv::Mat &dst, const cv::Scalar &background);
+
+// [source: 8UC3, 8UC4, 16UC3, 16UC4][canvas: 8U, 16U]
+static const CompositeFunc kComposite[4][2] = {
+	{Composite<uchar, 3, uchar>, Composite<uchar, 3, ushort>},
+	{Composite<uchar, 4, uchar>, Composite<uchar, 4, ushort>},
+	{Composite<ushort, 3, uchar>, Composite<ushort, 3, ushort>},
+	{Composite<ushort, 4, uchar>, Composite<ushort, 4, ushort>},
+};
+
+static int SourceIndex(int type)
+{
+	switch (type)
+	{
+	case CV_8UC3:
+		return 0;
+	case CV_8UC4:
+		return 1;
+	case CV_16UC3:
+		return 2;
+	case CV_16UC4:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+cv::Mat PrepareSource(cv::Mat image)
+{
+	if (image.empty())
+		return image;
+
+	// float images (EXR, HDR) are expected in [0, 1]
+	int depth = image.depth();
+	if (depth != CV_8U && depth != CV_16U)
+		image.convertTo(image, CV_16U, depth == CV_32F || depth == CV_64F ? 65535.0 : 1.0);
+
+	switch (image.channels())
+	{
+	case 1:
+		cv::cvtColor(image, image, cv::COLOR_GRAY2BGR);
+		break;
+	case 2:
+	{
+		// gray and alpha
+		cv::Mat bgra(image.size(), CV_MAKETYPE(image.depth(), 4));
+		const int fromTo[] = {0, 0, 0, 1, 0, 2, 1, 3};
+		cv::mixChannels(&image, 1, &bgra, 1, fromTo, 4);
+		image = bgra;
+		break;
+	}
+	case 3:
+	case 4:
+		break;
+	default:
+	{
+		// unknown layout, keep the first channel
+		cv::Mat gray;
+		cv::extractChannel(image, gray, 0);
+		cv::cvtColor(gray, image, cv::COLOR_GRAY2BGR);
+		break;
+	}
+	}
+
+	if (image.channels() == 4)
+	{
+		bool transparent = image.depth() == CV_8U ? Premultiply<uchar>(image) : Premultiply<ushort>(image);
+		if (!transparent)
+			cv::cvtColor(image, image, cv::COLOR_BGRA2BGR);
+	}
+	return image;
+}
+
+cv::Mat LoadSource(const std::string &path)
+{
+	// IMREAD_UNCHANGED keeps the depth and the alpha channel and ignores EXIF orientation,
+	// which is applied while resampling
+	return PrepareSource(cv::imread(path, cv::IMREAD_UNCHANGED));
+}
+
+FrameLayout MakeFrameLayout(const FrameSettings &settings, cv::Size imageSize, int orientation)
+{
+	FrameLayout layout;
+	cv::Size upright = OrientedSize(imageSize, orientation);
+	float width = settings.width;
+	float height = settings.height;
+	// landscape photos get a landscape frame and the other way around, the bottom strip stays at the bottom
+	if (settings.autoOrient && !upright.empty() && upright.width != upright.height && (upright.width > upright.height) != (width > height))
+		std::swap(width, height);
+	layout.size = cv::Size(cm2pixel(width, settings.ppi), cm2pixel(height, settings.ppi));
+	layout.orientation = orientation;
+	layout.bgColor = settings.bgColor;
+	layout.borderColor = settings.borderColor;
+	layout.ppi = settings.ppi;
+
+	// crash when input width, height
+	if (layout.size.empty())
+		return layout;
+
+	float borderOfsetPixel = cm2pixel(settings.borderOffset, settings.ppi);
+	float bottomOfsetPixel = cm2pixel(settings.bottomOffset, settings.ppi);
+	cv::Rect borderRect = cv::Rect(borderOfsetPixel, borderOfsetPixel, layout.size.width - borderOfsetPixel * 2, layout.size.height - borderOfsetPixel * 2 - bottomOfsetPixel);
+	if (!RoiRefine(borderRect, layout.size))
+		return layout;
+
+	layout.borderRect = borderRect;
+	layout.imageRect = borderRect;
+	if (!upright.empty())
+	{
+		cv::Size dstSize = borderRect.size();
+		double h1 = dstSize.width * (upright.height / (double)upright.width);
+		double w2 = dstSize.height * (upright.width / (double)upright.height);
+		cv::Size fitted = h1 <= dstSize.height ? cv::Size(dstSize.width, std::max(1, (int)h1)) : cv::Size(std::max(1, (int)w2), dstSize.height);
+		layout.imageRect = cv::Rect(borderRect.x + (dstSize.width - fitted.width) / 2, borderRect.y + (dstSize.height - fitted.height) / 2, fitted.width, fitted.height);
+	}
+	return layout;
+}
+
+void ComposeRegion(const cv::Mat &src, const FrameLayout &layout, cv::Rect region, double scale, int interpolation, cv::Mat &dst, int depth)
+{
+	CV_Assert(depth == CV_8U || depth == CV_16U);
+	// layout colors are 8-bit
+	double unit = depth == CV_16U ? 257.0 : 1.0;
+	dst.create(region.size(), CV_MAKETYPE(depth, 3));
+	dst.setTo(layout.borderColor * unit);
+	if (layout.borderRect.empty() || scale <= 0)
+		return;
+
+	cv::Rect windowRect = ScaleRect(layout.borderRect, scale) & region;
+	if (windowRect.empty())
+		return;
+	dst(windowRect - region.tl()).setTo(src.empty() ? cv::Scalar::all(0) : layout.bgColor * unit);
+	if (src.empty())
+		return;
+	int index = SourceIndex(src.type());
+	CV_Assert(index >= 0); // sources go through PrepareSource
+
+	cv::Rect imageRect = ScaleRect(layout.imageRect, scale) & region;
+	if (imageRect.empty())
+		return;
+
+	// map destination pixel centers back to pixel indices of the upright source
+	cv::Size upright = OrientedSize(src.size(), layout.orientation);
+	double ax = upright.width / (layout.imageRect.width * scale);
+	double ay = upright.height / (layout.imageRect.height * scale);
+	double bx = ((imageRect.x + 0.5) / scale - layout.imageRect.x) * upright.width / layout.imageRect.width - 0.5;
+	double by = ((imageRect.y + 0.5) / scale - layout.imageRect.y) * upright.height / layout.imageRect.height - 0.5;
+
+	// then through the EXIF orientation to the stored pixels, so turning the photo
+	// costs nothing more than the resample itself
+	cv::Matx23d O = OrientationMatrix(layout.orientation, src.size());
+	cv::Matx23d M(O(0, 0) * ax, O(0, 1) * ay, O(0, 0) * bx + O(0, 1) * by + O(0, 2),
+				  O(1, 0) * ax, O(1, 1) * ay, O(1, 0) * bx + O(1, 1) * by + O(1, 2));
+
+	cv::Mat target = dst(imageRect - region.tl());
+	if (src.type() == target.type())
+	{
+		Resample(src, target, M, interpolation);
+		return;
+	}
+	// other depth or alpha: resample at the source type, then blend and convert in one pass
+	cv::Mat sampled(target.size(), src.type());
+	Resample(src, sampled, M, interpolation);
+	kComposite[index][depth == CV_16U](sampled, target, layout.bgColor);
+}
@@ -0,0 +1,59 @@
+#ifndef _FRAME_H_
+#define _FRAME_H_
+#include <string>
+#include "opencv2/core.hpp"
+
+// Print settings of a polaroid frame, lengths are in centimeters.
+struct FrameSettings
+{
+	float width = 6;
+	float height = 9;
+	float borderOffset = 0.25;
+	float bottomOffset = 0.75;
+	int ppi = 300;
+	bool autoOrient = true; // swap width and height to follow portrait / landscape photos
+	cv::Scalar bgColor = cv::Scalar(255, 255, 255);
+	cv::Scalar borderColor = cv::Scalar(255, 255, 255);
+
+	bool operator==(const FrameSettings &other) const
+	{
+		return width == other.width && height == other.height &&
+			   borderOffset == other.borderOffset && bottomOffset == other.bottomOffset && ppi == other.ppi && autoOrient == other.autoOrient &&
+			   bgColor == other.bgColor && borderColor == other.borderColor;
+	}
+	bool operator!=(const FrameSettings &other) const { return !(*this == other); }
+};
+
+// Pixel geometry of a frame at print resolution (layout.ppi).
+struct FrameLayout
+{
+	cv::Size size;			// whole canvas, filled with the border color
+	cv::Rect borderRect;	// photo window, letterboxed with the background color
+	cv::Rect imageRect;		// photo fitted inside borderRect keeping its aspect ratio
+	cv::Scalar bgColor;
+	cv::Scalar borderColor;
+	int ppi = 300;
+	int orientation = 1;	// EXIF orientation of the source, applied while sampling
+
+	bool empty() const { return size.empty(); }
+};
+
+// imageSize is the stored size of the source, orientation its EXIF orientation.
+FrameLayout MakeFrameLayout(const FrameSettings &settings, cv::Size imageSize, int orientation = 1);
+
+// Bring a decoded image to one of the types ComposeRegion samples: 8 or 16 bit,
+// BGR or BGRA. Alpha is premultiplied so resampling does not bleed the color of
+// transparent pixels, and dropped when the image turns out to be opaque.
+// The pixels of image are modified in place.
+cv::Mat PrepareSource(cv::Mat image);
+
+// Decode path at its own depth, with alpha and without applying EXIF orientation, then PrepareSource.
+cv::Mat LoadSource(const std::string &path);
+
+// Compose the region of the frame seen at the given scale (1 = print resolution)
+// straight from the source image. region is expressed in scaled pixels, so a
+// tile of a downscaled level only samples the source pixels it covers and the
+// full canvas never has to exist in memory.
+// dst is BGR of the given depth (CV_8U or CV_16U), an alpha source is blended over the background color.
+void ComposeRegion(const cv::Mat &src, const FrameLayout &layout, cv::Rect region, double scale, int interpolation, cv::Mat &dst, int depth = CV_8U);
+#endif
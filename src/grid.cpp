@@ -0,0 +1,426 @@
+#include "grid.h"
+#include <algorithm>
+#include <cstddef>
+#include "logger.h"
+
+// new thumbnails copied per frame, the others show the placeholder until the next frames
+static const int kCopiesPerFrame = 32;
+
+// One quad per instance, the corners come from gl_VertexID so no vertex buffer is needed.
+static const char *kVertexShader = R"(#version 330 core
+layout(location = 0) in vec4 aRect;
+layout(location = 1) in vec4 aWindow;
+layout(location = 2) in vec4 aImage;
+layout(location = 3) in vec4 aTexture;
+layout(location = 4) in vec4 aBorder;
+layout(location = 5) in vec4 aBackground;
+uniform mat4 uProjection;
+out vec2 vFrame;
+flat out vec4 vWindow;
+flat out vec4 vImage;
+flat out vec4 vTexture;
+flat out vec4 vBorder;
+flat out vec4 vBackground;
+void main()
+{
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	vFrame = corner;
+	vWindow = aWindow;
+	vImage = aImage;
+	vTexture = aTexture;
+	vBorder = aBorder;
+	vBackground = aBackground;
+	gl_Position = uProjection * vec4(mix(aRect.xy, aRect.zw, corner), 0.0, 1.0);
+}
+)";
+
+// The frame is drawn the way ComposeRegion composes it: border, photo window, photo.
+static const char *kFragmentShader = R"(#version 330 core
+uniform sampler2DArray uPhotos;
+in vec2 vFrame;
+flat in vec4 vWindow;
+flat in vec4 vImage;
+flat in vec4 vTexture;
+flat in vec4 vBorder;
+flat in vec4 vBackground;
+out vec4 oColor;
+bool Inside(vec2 p, vec4 r)
+{
+	return all(greaterThanEqual(p, r.xy)) && all(lessThan(p, r.zw));
+}
+void main()
+{
+	if (!Inside(vFrame, vWindow))
+	{
+		oColor = vBorder;
+		return;
+	}
+	if (!Inside(vFrame, vImage))
+	{
+		oColor = vBackground;
+		return;
+	}
+	if (vTexture.z < 0.0)
+	{
+		oColor = vec4(vec3(60.0 / 255.0), 1.0); // thumbnail not decoded yet
+		return;
+	}
+	// stay half a texel inside the photo, the rest of the layer holds older content
+	vec2 halfTexel = 0.5 / vec2(textureSize(uPhotos, 0).xy);
+	vec2 uv = (vFrame - vImage.xy) / (vImage.zw - vImage.xy) * vTexture.xy;
+	uv = clamp(uv, halfTexel, vTexture.xy - halfTexel);
+	oColor = vec4(texture(uPhotos, vec3(uv, vTexture.z)).rgb, 1.0);
+}
+)";
+
+// Immutable storage when available, like the textures of the pool; layers are only ever overwritten.
+static GLuint AllocateArray(int layers, int size)
+{
+	GLuint id = 0;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+#if defined(GL_VERSION_4_2) || defined(GL_ARB_texture_storage)
+	if (HasTextureStorage())
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGB8, size, size, layers);
+	else
+#endif
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, size, size, layers, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return id;
+}
+
+static GLuint CompileShader(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+	GLint status = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		LOG_ERROR("Grid shader: %s", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+// RGBA from a BGR cv::Scalar
+static void PackColor(const cv::Scalar &color, uint8_t rgba[4])
+{
+	rgba[0] = cv::saturate_cast<uint8_t>(color[2]);
+	rgba[1] = cv::saturate_cast<uint8_t>(color[1]);
+	rgba[2] = cv::saturate_cast<uint8_t>(color[0]);
+	rgba[3] = 255;
+}
+
+static void NormalizeRect(const cv::Rect &rect, cv::Size size, float out[4])
+{
+	out[0] = rect.x / (float)size.width;
+	out[1] = rect.y / (float)size.height;
+	out[2] = (rect.x + rect.width) / (float)size.width;
+	out[3] = (rect.y + rect.height) / (float)size.height;
+}
+
+ContactGrid::~ContactGrid()
+{
+	Release();
+}
+
+bool ContactGrid::Create()
+{
+	if (mCreated || mFailed)
+		return mCreated;
+
+	GLuint vertex = CompileShader(GL_VERTEX_SHADER, kVertexShader);
+	GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, kFragmentShader);
+	if (vertex && fragment)
+	{
+		mProgram = glCreateProgram();
+		glAttachShader(mProgram, vertex);
+		glAttachShader(mProgram, fragment);
+		glLinkProgram(mProgram);
+		GLint status = 0;
+		glGetProgramiv(mProgram, GL_LINK_STATUS, &status);
+		if (!status)
+		{
+			char log[1024];
+			glGetProgramInfoLog(mProgram, sizeof(log), nullptr, log);
+			LOG_ERROR("Grid program: %s", log);
+			glDeleteProgram(mProgram);
+			mProgram = 0;
+		}
+	}
+	if (vertex)
+		glDeleteShader(vertex);
+	if (fragment)
+		glDeleteShader(fragment);
+	if (!mProgram)
+	{
+		mFailed = true;
+		return false;
+	}
+	mProjectionLocation = glGetUniformLocation(mProgram, "uProjection");
+	mPhotosLocation = glGetUniformLocation(mProgram, "uPhotos");
+
+	glGenBuffers(1, &mInstanceBuffer);
+	glGenFramebuffers(1, &mReadFramebuffer);
+	glGenFramebuffers(1, &mDrawFramebuffer);
+
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &mMaxLayers);
+	mCapacity = std::clamp(mCapacity, 1, std::max(1, mMaxLayers));
+	mArray = AllocateArray(mCapacity, kLayerSize);
+	mLayers.assign(mCapacity, Layer());
+	mCreated = true;
+	return true;
+}
+
+void ContactGrid::Release()
+{
+	if (mProgram)
+		glDeleteProgram(mProgram);
+	if (mInstanceBuffer)
+		glDeleteBuffers(1, &mInstanceBuffer);
+	if (mReadFramebuffer)
+		glDeleteFramebuffers(1, &mReadFramebuffer);
+	if (mDrawFramebuffer)
+		glDeleteFramebuffers(1, &mDrawFramebuffer);
+	if (mArray)
+		glDeleteTextures(1, &mArray);
+	mProgram = mInstanceBuffer = mReadFramebuffer = mDrawFramebuffer = mArray = 0;
+	mCreated = false;
+	mLayers.clear();
+	mResident.clear();
+	mCopies.clear();
+	mInstances.clear();
+	mDrawCount = 0;
+}
+
+void ContactGrid::Begin()
+{
+	mFrame++;
+	mCopies.clear();
+	mInstances.clear();
+}
+
+void ContactGrid::Add(const std::string &key, const Texture2D &thumbnail, ImVec2 min, ImVec2 max, const FrameLayout &layout)
+{
+	if (layout.empty() || layout.borderRect.empty())
+		return;
+
+	Instance instance;
+	instance.rect[0] = min.x;
+	instance.rect[1] = min.y;
+	instance.rect[2] = max.x;
+	instance.rect[3] = max.y;
+	NormalizeRect(layout.borderRect, layout.size, instance.window);
+	NormalizeRect(layout.imageRect, layout.size, instance.image);
+	PackColor(layout.borderColor, instance.border);
+	PackColor(layout.bgColor, instance.background);
+
+	int layer = Create() ? FindLayer(key, thumbnail) : -1;
+	instance.texture[0] = std::min(thumbnail.GetWidth(), kLayerSize) / (float)kLayerSize;
+	instance.texture[1] = std::min(thumbnail.GetHeight(), kLayerSize) / (float)kLayerSize;
+	instance.texture[2] = (float)layer;
+	instance.texture[3] = 0.0f;
+	mInstances.push_back(instance);
+}
+
+int ContactGrid::FindLayer(const std::string &key, const Texture2D &thumbnail)
+{
+	auto it = mResident.find(key);
+	if (it != mResident.end())
+	{
+		mLayers[it->second].used = mFrame;
+		return it->second;
+	}
+	if (!thumbnail || (int)mCopies.size() >= kCopiesPerFrame)
+		return -1;
+
+	// a free layer, else the least recently drawn one that is not on screen
+	int best = -1;
+	for (int i = 0; i < (int)mLayers.size(); i++)
+	{
+		if (mLayers[i].key.empty())
+		{
+			best = i;
+			break;
+		}
+		if (mLayers[i].used != mFrame && (best < 0 || mLayers[i].used < mLayers[best].used))
+			best = i;
+	}
+	if (best < 0)
+	{
+		// every layer is on screen, add one, Draw grows the array before copying
+		if ((int)mLayers.size() >= mMaxLayers)
+			return -1;
+		best = (int)mLayers.size();
+		mLayers.emplace_back();
+	}
+
+	if (!mLayers[best].key.empty())
+		mResident.erase(mLayers[best].key);
+	mLayers[best].key = key;
+	mLayers[best].used = mFrame;
+	mResident[key] = best;
+	mCopies.push_back({thumbnail.GetID(), std::min(thumbnail.GetWidth(), kLayerSize), std::min(thumbnail.GetHeight(), kLayerSize), best});
+	return best;
+}
+
+void ContactGrid::Grow()
+{
+	// doubling keeps the number of reallocations logarithmic in the cells on screen
+	int capacity = std::min(std::max((int)mLayers.size(), mCapacity * 2), mMaxLayers);
+	GLuint array = AllocateArray(capacity, kLayerSize);
+	for (int layer = 0; layer < mCapacity; layer++)
+	{
+		if (mLayers[layer].key.empty())
+			continue;
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mArray, 0, layer);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0, layer);
+		glBlitFramebuffer(0, 0, kLayerSize, kLayerSize, 0, 0, kLayerSize, kLayerSize, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+	glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0);
+	glDeleteTextures(1, &mArray);
+	mArray = array;
+	mCapacity = capacity;
+	mLayers.resize(capacity);
+}
+
+void ContactGrid::Draw(ImDrawList *drawList)
+{
+	if (mInstances.empty() || !mCreated)
+		return;
+
+	if (!mCopies.empty())
+	{
+		// GPU to GPU copies, the previous bindings are restored for the UI
+		GLint lastRead = 0, lastDraw = 0;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &lastRead);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &lastDraw);
+		GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+		glDisable(GL_SCISSOR_TEST);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, mReadFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mDrawFramebuffer);
+		if ((int)mLayers.size() > mCapacity)
+			Grow();
+		for (const Copy &copy : mCopies)
+		{
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, copy.texture, 0);
+			glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mArray, 0, copy.layer);
+			glBlitFramebuffer(0, 0, copy.width, copy.height, 0, 0, copy.width, copy.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
+		// the thumbnails go back to the pool later, do not keep them attached
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, lastRead);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, lastDraw);
+		if (scissor)
+			glEnable(GL_SCISSOR_TEST);
+		mCopies.clear();
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mInstances.size() * sizeof(Instance), mInstances.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	mDrawCount = (int)mInstances.size();
+
+	ImGuiViewport *viewport = ImGui::GetWindowViewport();
+	mDisplayPos = viewport->Pos;
+	mDisplaySize = viewport->Size;
+	drawList->AddCallback(Callback, this);
+	drawList->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
+void ContactGrid::Callback(const ImDrawList *, const ImDrawCmd *cmd)
+{
+	((ContactGrid *)cmd->UserCallbackData)->Render(cmd);
+}
+
+void ContactGrid::Render(const ImDrawCmd *cmd)
+{
+	if (!mDrawCount || mDisplaySize.x <= 0.0f || mDisplaySize.y <= 0.0f)
+		return;
+
+	// the backend has set the viewport of the platform window, rebuild its projection and clip
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	float scaleX = viewport[2] / mDisplaySize.x;
+	float scaleY = viewport[3] / mDisplaySize.y;
+	ImVec4 clip = cmd->ClipRect;
+	int clipX = (int)((clip.x - mDisplayPos.x) * scaleX);
+	int clipY = (int)((clip.y - mDisplayPos.y) * scaleY);
+	int clipW = (int)((clip.z - clip.x) * scaleX);
+	int clipH = (int)((clip.w - clip.y) * scaleY);
+	if (clipW <= 0 || clipH <= 0)
+		return;
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(clipX, viewport[3] - (clipY + clipH), clipW, clipH);
+
+	float L = mDisplayPos.x;
+	float R = mDisplayPos.x + mDisplaySize.x;
+	float T = mDisplayPos.y;
+	float B = mDisplayPos.y + mDisplaySize.y;
+	const float projection[4][4] = {
+		{2.0f / (R - L), 0.0f, 0.0f, 0.0f},
+		{0.0f, 2.0f / (T - B), 0.0f, 0.0f},
+		{0.0f, 0.0f, -1.0f, 0.0f},
+		{(R + L) / (L - R), (T + B) / (B - T), 0.0f, 1.0f},
+	};
+	glUseProgram(mProgram);
+	glUniformMatrix4fv(mProjectionLocation, 1, GL_FALSE, &projection[0][0]);
+	glUniform1i(mPhotosLocation, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mArray);
+
+	// VAOs are not shared between the contexts of the platform windows, one is made per draw like the ImGui backend does
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer);
+	const GLsizei stride = sizeof(Instance);
+	const size_t floats[] = {offsetof(Instance, rect), offsetof(Instance, window), offsetof(Instance, image), offsetof(Instance, texture)};
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glEnableVertexAttribArray(i);
+		glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, stride, (const void *)floats[i]);
+		glVertexAttribDivisor(i, 1);
+	}
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const void *)offsetof(Instance, border));
+	glVertexAttribDivisor(4, 1);
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const void *)offsetof(Instance, background));
+	glVertexAttribDivisor(5, 1);
+
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, mDrawCount);
+
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void ContactGrid::Invalidate(const std::string &key)
+{
+	auto it = mResident.find(key);
+	if (it == mResident.end())
+		return;
+	mLayers[it->second].key.clear();
+	mLayers[it->second].used = 0;
+	mResident.erase(it);
+}
+
+void ContactGrid::Clear()
+{
+	for (auto &layer : mLayers)
+		layer = Layer();
+	mResident.clear();
+}
@@ -0,0 +1,102 @@
+#ifndef _GRID_H_
+#define _GRID_H_
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "imgui.h"
+#include "texture.h"
+#include "frame.h"
+
+// Contact sheet of framed previews drawn by the GPU in one instanced call.
+// Thumbnails are copied (framebuffer blit, no CPU readback) into the layers of
+// a GL_TEXTURE_2D_ARRAY kept in LRU order, grown when every layer is on screen
+// (up to GL_MAX_ARRAY_TEXTURE_LAYERS); each cell is one instance carrying
+// its screen rect, frame geometry and colors, and the fragment shader draws
+// the border, the background and the photo. Nothing is composed on the CPU.
+class ContactGrid
+{
+public:
+	// Side of a layer, thumbnails larger than that are cropped.
+	static const int kLayerSize = 256;
+
+	// layers is the initial size of the array.
+	explicit ContactGrid(int layers = 256) : mCapacity(layers) {}
+	ContactGrid(const ContactGrid &) = delete;
+	ContactGrid &operator=(const ContactGrid &) = delete;
+	~ContactGrid();
+
+	// Start the cells of a new frame.
+	void Begin();
+	// Queue a cell: the frame of layout fitted in the screen rect [min, max], the photo
+	// from thumbnail. key names the photo, an invalid thumbnail draws a placeholder.
+	void Add(const std::string &key, const Texture2D &thumbnail, ImVec2 min, ImVec2 max, const FrameLayout &layout);
+	// Copy the new thumbnails to their layers and add the draw call of the queued cells to drawList.
+	void Draw(ImDrawList *drawList);
+
+	// The thumbnail of key changed, copy it again next time.
+	void Invalidate(const std::string &key);
+	// Forget every layer, their content is overwritten as cells come back.
+	void Clear();
+	// Delete the GL objects. Must be called while the GL context is current.
+	void Release();
+
+	size_t GetResidentCount() const { return mResident.size(); }
+	int GetCapacity() const { return mCapacity; }
+
+private:
+	// Per instance attributes, see the vertex shader.
+	struct Instance
+	{
+		float rect[4];		  // screen min, max
+		float window[4];	  // photo window in frame coordinates (0..1)
+		float image[4];		  // photo in frame coordinates
+		float texture[4];	  // extent of the photo in its layer (u, v), layer or -1, unused
+		uint8_t border[4];	  // RGBA
+		uint8_t background[4];
+	};
+
+	struct Layer
+	{
+		std::string key;
+		uint64_t used = 0; // frame of the last draw
+	};
+
+	struct Copy
+	{
+		uint32_t texture;
+		int width;
+		int height;
+		int layer;
+	};
+
+	bool Create();
+	int FindLayer(const std::string &key, const Texture2D &thumbnail);
+	// Reallocate the array for the layers added since the last frame, keeping their content.
+	// Called by Draw with the copy framebuffers bound.
+	void Grow();
+	static void Callback(const ImDrawList *list, const ImDrawCmd *cmd);
+	void Render(const ImDrawCmd *cmd);
+
+	int mCapacity;		// layers of mArray, mLayers may be longer until the next Draw
+	int mMaxLayers = 0; // GL_MAX_ARRAY_TEXTURE_LAYERS
+	bool mCreated = false;
+	bool mFailed = false;
+	uint32_t mProgram = 0;
+	int mProjectionLocation = -1;
+	int mPhotosLocation = -1;
+	uint32_t mInstanceBuffer = 0;
+	uint32_t mArray = 0;
+	uint32_t mReadFramebuffer = 0;
+	uint32_t mDrawFramebuffer = 0;
+
+	uint64_t mFrame = 0;
+	std::vector<Layer> mLayers;
+	std::unordered_map<std::string, int> mResident; // layer by key
+	std::vector<Copy> mCopies;						// thumbnails to blit this frame
+	std::vector<Instance> mInstances;
+	int mDrawCount = 0;	 // instances in mInstanceBuffer
+	ImVec2 mDisplayPos{}; // viewport the cells are drawn in
+	ImVec2 mDisplaySize{};
+};
+#endif
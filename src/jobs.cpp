@@ -0,0 +1,194 @@
+#include "jobs.h"
+#include <algorithm>
+
+static const int kBatch = (int)JobPriority::Batch;
+
+// Index of the calling worker, -1 on other threads
+static thread_local int sWorkerIndex = -1;
+
+JobSystem &JobSystem::Get()
+{
+	static JobSystem system;
+	return system;
+}
+
+void JobSystem::Start(int workers)
+{
+	if (!mWorkers.empty())
+		return;
+	if (workers <= 0)
+		workers = (int)std::thread::hardware_concurrency() - 1;
+	// on one or two cores a lone worker would let an export hold back the image on screen
+	workers = std::max(2, workers);
+
+	mStopping = false;
+	mBatchLimit = workers - 1;
+	for (int i = 0; i < workers; i++)
+		mWorkers.push_back(CreateScope<Worker>());
+	for (int i = 0; i < workers; i++)
+		mWorkers[i]->thread = std::thread([this, i]() { Run(i); });
+}
+
+void JobSystem::Stop()
+{
+	if (mWorkers.empty())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+	for (auto &worker : mWorkers)
+		worker->thread.join();
+	mWorkers.clear();
+	for (auto &depth : mDepth)
+		depth = 0;
+
+	std::lock_guard<std::mutex> lock(mMainMutex);
+	mMainQueue.clear();
+}
+
+void JobSystem::Submit(JobPriority priority, Job job, CancelToken token)
+{
+	if (mWorkers.empty())
+	{
+		// not started, run inline so callers behave the same without workers
+		if (!token.IsCancelled())
+			job();
+		return;
+	}
+
+	int self = sWorkerIndex;
+	size_t target = self >= 0 ? (size_t)self : mNext++ % mWorkers.size();
+	{
+		std::lock_guard<std::mutex> lock(mWorkers[target]->mutex);
+		mWorkers[target]->queues[(int)priority].push_back({std::move(job), std::move(token)});
+	}
+	mDepth[(int)priority]++;
+	Wake();
+}
+
+void JobSystem::Post(Job job, CancelToken token)
+{
+	std::lock_guard<std::mutex> lock(mMainMutex);
+	mMainQueue.push_back({std::move(job), std::move(token)});
+}
+
+void JobSystem::DrainMainThread(std::chrono::microseconds budget)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (;;)
+	{
+		Task task;
+		{
+			std::lock_guard<std::mutex> lock(mMainMutex);
+			if (mMainQueue.empty())
+				return;
+			task = std::move(mMainQueue.front());
+			mMainQueue.pop_front();
+		}
+		if (!task.token.IsCancelled())
+			task.job();
+		if (std::chrono::steady_clock::now() - start >= budget)
+			return;
+	}
+}
+
+size_t JobSystem::GetMainQueueDepth() const
+{
+	std::lock_guard<std::mutex> lock(mMainMutex);
+	return mMainQueue.size();
+}
+
+bool JobSystem::HasRunnable() const
+{
+	for (int priority = 0; priority < kBatch; priority++)
+	{
+		if (mDepth[priority] > 0)
+			return true;
+	}
+	return mDepth[kBatch] > 0 && mBatchRunning < mBatchLimit;
+}
+
+void JobSystem::Wake()
+{
+	// taking the lock orders the queue update before a worker re-checks HasRunnable
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	mWake.notify_one();
+}
+
+bool JobSystem::Pop(size_t self, Task &task, bool &batch)
+{
+	size_t count = mWorkers.size();
+	for (int priority = 0; priority < JOB_PRIORITY_COUNT; priority++)
+	{
+		if (!mDepth[priority])
+			continue;
+
+		batch = priority == kBatch;
+		if (batch)
+		{
+			// reserve a batch slot first, one worker always stays free for the other classes
+			int running = mBatchRunning;
+			do
+			{
+				if (running >= mBatchLimit)
+					return false;
+			} while (!mBatchRunning.compare_exchange_weak(running, running + 1));
+		}
+
+		// own queue oldest first, stolen work newest first
+		for (size_t i = 0; i < count; i++)
+		{
+			Worker &worker = *mWorkers[(self + i) % count];
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			auto &queue = worker.queues[priority];
+			if (queue.empty())
+				continue;
+			if (i == 0)
+			{
+				task = std::move(queue.front());
+				queue.pop_front();
+			}
+			else
+			{
+				task = std::move(queue.back());
+				queue.pop_back();
+			}
+			mDepth[priority]--;
+			return true;
+		}
+
+		if (batch)
+			mBatchRunning--;
+	}
+	return false;
+}
+
+void JobSystem::Run(size_t self)
+{
+	sWorkerIndex = (int)self;
+	while (!mStopping)
+	{
+		Task task;
+		bool batch = false;
+		if (Pop(self, task, batch))
+		{
+			mRunning++;
+			if (!task.token.IsCancelled())
+				task.job();
+			mRunning--;
+			if (batch)
+			{
+				mBatchRunning--;
+				Wake(); // a batch job may have been waiting for the slot
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mWake.wait(lock, [this]() { return mStopping || HasRunnable(); });
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef _JOBS_H_
+#define _JOBS_H_
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ref.h"
+
+// Scheduling classes, a worker always takes the most urgent job available.
+enum class JobPriority
+{
+	Interactive, // the image on screen
+	Visible,	 // thumbnails of the strip
+	Prefetch,	 // neighbours of the current image
+	Batch		 // exports
+};
+#define JOB_PRIORITY_COUNT 4
+
+// Copies share one flag. Jobs submitted with a cancelled token are dropped
+// before they start; long jobs may also poll IsCancelled() between steps.
+class CancelToken
+{
+public:
+	CancelToken() : mFlag(std::make_shared<std::atomic<bool>>(false)) {}
+
+	void Cancel() const { mFlag->store(true); }
+	bool IsCancelled() const { return mFlag->load(std::memory_order_relaxed); }
+
+private:
+	std::shared_ptr<std::atomic<bool>> mFlag;
+};
+
+// Shared pool of worker threads with per worker queues; idle workers steal
+// from the others. Batch jobs never occupy every worker, so interactive work
+// still starts right away while a large export is running.
+// Jobs that touch GL or the UI state are posted back to the main thread and
+// run by DrainMainThread once per frame.
+class JobSystem
+{
+public:
+	using Job = std::function<void()>;
+
+	static JobSystem &Get();
+
+	// workers = 0 uses one worker per hardware thread, the main thread excluded.
+	// At least two workers are started so one is always kept back from batch jobs.
+	void Start(int workers = 0);
+	// Drop every pending job and join the workers, running jobs finish first.
+	void Stop();
+
+	void Submit(JobPriority priority, Job job, CancelToken token = {});
+	void Post(Job job, CancelToken token = {});
+	// Run posted jobs until the queue is empty or the budget is spent.
+	void DrainMainThread(std::chrono::microseconds budget = std::chrono::microseconds(4000));
+
+	size_t GetQueueDepth(JobPriority priority) const { return mDepth[(int)priority]; }
+	size_t GetMainQueueDepth() const;
+	size_t GetRunningCount() const { return mRunning; }
+	size_t GetWorkerCount() const { return mWorkers.size(); }
+
+	~JobSystem() { Stop(); }
+
+private:
+	struct Task
+	{
+		Job job;
+		CancelToken token;
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> queues[JOB_PRIORITY_COUNT];
+		std::thread thread;
+	};
+
+	JobSystem() = default;
+	void Run(size_t self);
+	bool Pop(size_t self, Task &task, bool &batch);
+	bool HasRunnable() const;
+	void Wake();
+
+	std::vector<Scope<Worker>> mWorkers;
+	std::atomic<size_t> mDepth[JOB_PRIORITY_COUNT]{};
+	std::atomic<size_t> mNext{0}; // round robin for jobs submitted from outside the workers
+	std::atomic<int> mBatchRunning{0};
+	std::atomic<size_t> mRunning{0};
+	int mBatchLimit = 1;
+	std::atomic<bool> mStopping{false};
+	std::mutex mSleepMutex;
+	std::condition_variable mWake;
+
+	mutable std::mutex mMainMutex;
+	std::deque<Task> mMainQueue;
+};
+#endif
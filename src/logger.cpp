@@ -0,0 +1,211 @@
+#include "logger.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdlib>
+#include <ctime>
+
+static const size_t kRingMask = LOG_RING_SIZE - 1;
+static_assert((LOG_RING_SIZE & kRingMask) == 0, "LOG_RING_SIZE must be a power of two");
+
+static const char *LevelName(LogLevel level)
+{
+	switch (level)
+	{
+	case LogLevel::Trace:
+		return "trace";
+	case LogLevel::Debug:
+		return "debug";
+	case LogLevel::Info:
+		return "info";
+	case LogLevel::Warn:
+		return "warn";
+	default:
+		return "error";
+	}
+}
+
+// Small sequential ids read better in the log than std::thread::id
+static uint32_t ThreadNumber()
+{
+	static std::atomic<uint32_t> next{0};
+	static thread_local uint32_t number = next++;
+	return number;
+}
+
+Logger &Logger::Get()
+{
+	static Logger *logger = new Logger();
+	return *logger;
+}
+
+Logger::Logger()
+{
+	for (size_t i = 0; i < LOG_RING_SIZE; i++)
+		mCells[i].sequence.store(i, std::memory_order_relaxed);
+	mRunning = true;
+	mThread = std::thread([this]() { Run(); });
+	// exit() and returning from main both drain what is left in the ring
+	std::atexit([]() { Logger::Get().Close(); });
+}
+
+bool Logger::Open(const std::string &path)
+{
+	FILE *file = stderr;
+	if (!path.empty())
+	{
+		file = fopen(path.c_str(), "a");
+		if (!file)
+			return false;
+	}
+	std::lock_guard<std::mutex> lock(mFileMutex);
+	if (mFile != stderr)
+		fclose(mFile);
+	mFile = file;
+	return true;
+}
+
+void Logger::Write(LogLevel level, const char *format, ...)
+{
+	if (!IsEnabled(level))
+		return;
+
+	Record record;
+	record.level = level;
+	record.time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	record.thread = ThreadNumber();
+	va_list args;
+	va_start(args, format);
+	vsnprintf(record.text, sizeof(record.text), format, args);
+	va_end(args);
+
+	if (!mRunning)
+	{
+		std::lock_guard<std::mutex> lock(mFileMutex);
+		Print(record);
+		fflush(mFile);
+		return;
+	}
+	if (!Push(record))
+		mDropped++;
+}
+
+bool Logger::Push(const Record &record)
+{
+	size_t pos = mEnqueue.load(std::memory_order_relaxed);
+	Cell *cell;
+	for (;;)
+	{
+		cell = &mCells[pos & kRingMask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0)
+		{
+			if (mEnqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			return false; // full, the drain thread is behind
+		}
+		else
+		{
+			pos = mEnqueue.load(std::memory_order_relaxed);
+		}
+	}
+	cell->record = record;
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+bool Logger::Pop(Record &record)
+{
+	Cell &cell = mCells[mDequeue & kRingMask];
+	size_t sequence = cell.sequence.load(std::memory_order_acquire);
+	if ((intptr_t)sequence - (intptr_t)(mDequeue + 1) < 0)
+		return false;
+	record = cell.record;
+	cell.sequence.store(mDequeue + LOG_RING_SIZE, std::memory_order_release);
+	mDequeue++;
+	return true;
+}
+
+void Logger::Print(const Record &record)
+{
+	time_t seconds = (time_t)(record.time / 1000);
+	tm local;
+#ifdef _WIN32
+	localtime_s(&local, &seconds);
+#else
+	localtime_r(&seconds, &local);
+#endif
+	fprintf(mFile, "%02d:%02d:%02d.%03d [%s] [%u] %s\n", local.tm_hour, local.tm_min, local.tm_sec, (int)(record.time % 1000),
+			LevelName(record.level), record.thread, record.text);
+}
+
+void Logger::Run()
+{
+	Record record;
+	size_t reportedDrops = 0;
+	for (;;)
+	{
+		bool running = mRunning;
+		size_t count = 0;
+		{
+			std::lock_guard<std::mutex> lock(mFileMutex);
+			while (Pop(record))
+			{
+				Print(record);
+				count++;
+			}
+			size_t dropped = mDropped;
+			if (dropped != reportedDrops)
+			{
+				fprintf(mFile, "[warn] %zu log records dropped\n", dropped - reportedDrops);
+				reportedDrops = dropped;
+			}
+			if (count)
+				fflush(mFile);
+		}
+		mWritten += count;
+		if (!running)
+			return;
+		if (!count)
+		{
+			// producers never signal, a short nap keeps Write free of any lock
+			std::unique_lock<std::mutex> lock(mWakeMutex);
+			mWake.wait_for(lock, std::chrono::milliseconds(5), [this]() { return !mRunning; });
+		}
+	}
+}
+
+void Logger::Flush()
+{
+	// every record published before this point has a ticket below target
+	size_t target = mEnqueue.load();
+	while (mRunning && mWritten < target)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void Logger::Close()
+{
+	if (!mRunning)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mRunning = false;
+	}
+	mWake.notify_all();
+	mThread.join();
+
+	// records pushed while the thread was stopping
+	std::lock_guard<std::mutex> lock(mFileMutex);
+	Record record;
+	while (Pop(record))
+		Print(record);
+	fflush(mFile);
+}
+
+void logger(const char *msg)
+{
+	Logger::Get().Write(LogLevel::Info, "%s", msg);
+}
@@ -1,9 +1,95 @@
 #ifndef _LOG_H_
 #define _LOG_H_
-#include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
 
-void logger(const char* msg)
+enum class LogLevel
 {
-    std::cout << msg << std::endl;
-}
-#endif
\ No newline at end of file
+	Trace,
+	Debug,
+	Info,
+	Warn,
+	Error
+};
+
+// Longer messages are truncated.
+#define LOG_MESSAGE_SIZE 256
+// Records in flight, a power of two. When the ring is full new records are dropped and counted.
+#define LOG_RING_SIZE 4096
+
+// Asynchronous logger. Callers format into a fixed size record and publish
+// it in a lock-free multi-producer ring (Vyukov's bounded queue); a background
+// thread drains the ring to stderr or a file. Logging never waits on I/O, so
+// worker threads can log per image without slowing each other down.
+class Logger
+{
+public:
+	// Never destroyed, threads may log until the process ends.
+	static Logger &Get();
+
+	// Send the records to path (appending), or back to stderr when path is empty.
+	bool Open(const std::string &path);
+	void SetLevel(LogLevel level) { mLevel = (int)level; }
+	bool IsEnabled(LogLevel level) const { return (int)level >= mLevel; }
+
+	// printf style.
+	void Write(LogLevel level, const char *format, ...);
+	// Block until every record published so far has been written.
+	void Flush();
+	// Drain and stop the background thread, later records are written synchronously.
+	// Runs at exit on its own.
+	void Close();
+
+	size_t GetDroppedCount() const { return mDropped; }
+
+private:
+	struct Record
+	{
+		LogLevel level;
+		int64_t time; // milliseconds since epoch
+		uint32_t thread;
+		char text[LOG_MESSAGE_SIZE];
+	};
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		Record record;
+	};
+
+	Logger();
+	bool Push(const Record &record);
+	bool Pop(Record &record);
+	void Print(const Record &record);
+	void Run();
+
+	Cell mCells[LOG_RING_SIZE];
+	alignas(64) std::atomic<size_t> mEnqueue{0};
+	alignas(64) size_t mDequeue = 0; // drain thread only
+	std::atomic<size_t> mWritten{0};
+	std::atomic<size_t> mDropped{0};
+	std::atomic<int> mLevel{(int)LogLevel::Info};
+
+	std::mutex mFileMutex; // the output file, uncontended outside Open and Close
+	FILE *mFile = stderr;
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+	std::atomic<bool> mRunning{false};
+	std::thread mThread;
+};
+
+// Kept for the existing callers, logs at Info level.
+void logger(const char *msg);
+
+#define LOG_TRACE(...) Logger::Get().Write(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) Logger::Get().Write(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) Logger::Get().Write(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) Logger::Get().Write(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) Logger::Get().Write(LogLevel::Error, __VA_ARGS__)
+#endif
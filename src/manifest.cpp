@@ -0,0 +1,161 @@
+#include "manifest.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+// bump when the exported pixels change for the same settings
+static const char *kManifestHeader = "# polaroid export manifest 2";
+
+static uint64_t Fnv1a(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= p[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+template <typename T>
+static uint64_t Fnv1a(uint64_t hash, T value)
+{
+	return Fnv1a(hash, &value, sizeof(value));
+}
+
+uint64_t HashFrameSettings(const FrameSettings &settings)
+{
+	// field by field, struct padding must not take part in the hash
+	uint64_t hash = 0xcbf29ce484222325ull;
+	hash = Fnv1a(hash, settings.width);
+	hash = Fnv1a(hash, settings.height);
+	hash = Fnv1a(hash, settings.borderOffset);
+	hash = Fnv1a(hash, settings.bottomOffset);
+	hash = Fnv1a(hash, settings.ppi);
+	hash = Fnv1a(hash, (uint8_t)settings.autoOrient);
+	for (int i = 0; i < 4; i++)
+	{
+		hash = Fnv1a(hash, settings.bgColor[i]);
+		hash = Fnv1a(hash, settings.borderColor[i]);
+	}
+	return hash;
+}
+
+// The output name is used to delete files, it must stay inside the export folder.
+static bool IsPlainFileName(const std::string &name)
+{
+	return !name.empty() && name != "." && name != ".." && name.find_first_of("/\\") == std::string::npos;
+}
+
+void ExportManifest::Load()
+{
+	mEntries.clear();
+	std::ifstream file(std::filesystem::path(mFolder) / EXPORT_MANIFEST_NAME);
+	std::string line;
+	if (!std::getline(file, line) || line != kManifestHeader)
+		return;
+
+	while (std::getline(file, line))
+	{
+		std::vector<std::string> fields;
+		std::stringstream stream(line);
+		std::string field;
+		while (std::getline(stream, field, '\t'))
+			fields.push_back(field);
+		if (fields.size() != 5 || !IsPlainFileName(fields[0]))
+			continue;
+
+		ManifestEntry entry;
+		entry.output = fields[0];
+		entry.source = fields[1];
+		try
+		{
+			entry.size = std::stoull(fields[2]);
+			entry.mtime = std::stoll(fields[3]);
+			entry.settings = std::stoull(fields[4], nullptr, 16);
+		}
+		catch (const std::exception &)
+		{
+			continue;
+		}
+		mEntries[entry.output] = entry;
+	}
+}
+
+bool ExportManifest::Save() const
+{
+	std::filesystem::path path = std::filesystem::path(mFolder) / EXPORT_MANIFEST_NAME;
+	std::filesystem::path temp = path;
+	temp += ".tmp";
+	{
+		std::ofstream file(temp, std::ios::trunc);
+		file << kManifestHeader << '\n';
+		for (const auto &[name, entry] : mEntries)
+		{
+			char settings[17];
+			snprintf(settings, sizeof(settings), "%016llx", (unsigned long long)entry.settings);
+			file << entry.output << '\t' << entry.source << '\t' << entry.size << '\t' << entry.mtime << '\t' << settings << '\n';
+		}
+		if (!file.flush())
+			return false;
+	}
+	std::error_code error;
+	std::filesystem::rename(temp, path, error);
+	return !error;
+}
+
+bool ExportManifest::Describe(const std::string &source, const std::string &output, uint64_t settings, ManifestEntry &entry)
+{
+	std::error_code error;
+	entry.output = output;
+	entry.source = source;
+	entry.settings = settings;
+	entry.size = std::filesystem::file_size(source, error);
+	if (error)
+		return false;
+	entry.mtime = (int64_t)std::filesystem::last_write_time(source, error).time_since_epoch().count();
+	return !error;
+}
+
+bool ExportManifest::IsUpToDate(const ManifestEntry &entry) const
+{
+	auto it = mEntries.find(entry.output);
+	if (it == mEntries.end() || !(it->second == entry))
+		return false;
+	std::error_code error;
+	return std::filesystem::is_regular_file(std::filesystem::path(mFolder) / entry.output, error);
+}
+
+void ExportManifest::Update(const ManifestEntry &entry)
+{
+	// a separator in a field would break the line, such an entry is simply exported every time
+	if (!IsPlainFileName(entry.output) || entry.source.find_first_of("\t\r\n") != std::string::npos ||
+		entry.output.find_first_of("\t\r\n") != std::string::npos)
+	{
+		mEntries.erase(entry.output);
+		return;
+	}
+	mEntries[entry.output] = entry;
+}
+
+int ExportManifest::Prune()
+{
+	int removed = 0;
+	for (auto it = mEntries.begin(); it != mEntries.end();)
+	{
+		// images of other lists exported to the same folder stay, only a source that cannot be
+		// found any more takes its output along
+		std::error_code error;
+		if (std::filesystem::exists(it->second.source, error) || error)
+		{
+			++it;
+			continue;
+		}
+		if (std::filesystem::remove(std::filesystem::path(mFolder) / it->first, error))
+			removed++;
+		it = mEntries.erase(it);
+	}
+	return removed;
+}
@@ -0,0 +1,56 @@
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "frame.h"
+
+// File written next to the exported frames of a folder export.
+#define EXPORT_MANIFEST_NAME "polaroid-manifest.tsv"
+
+// One exported file and the state of the inputs it was made from.
+struct ManifestEntry
+{
+	std::string output;	  // file name inside the export folder
+	std::string source;	  // path of the source image
+	uintmax_t size = 0;	  // source size in bytes
+	int64_t mtime = 0;	  // source last write time, file clock ticks
+	uint64_t settings = 0; // HashFrameSettings of the frame it was exported with
+
+	bool operator==(const ManifestEntry &other) const
+	{
+		return output == other.output && source == other.source && size == other.size && mtime == other.mtime && settings == other.settings;
+	}
+};
+
+// FNV-1a over every field that changes the exported pixels.
+uint64_t HashFrameSettings(const FrameSettings &settings);
+
+// Record of a folder export, so the next export of the same folder only
+// decodes and encodes the images whose source or frame settings changed.
+// Stored as tab separated lines, one per output.
+class ExportManifest
+{
+public:
+	explicit ExportManifest(const std::string &folder) : mFolder(folder) {}
+
+	// A missing or unreadable manifest loads as empty, everything is exported again.
+	void Load();
+	// Written to a temporary file first, an interrupted save keeps the previous manifest.
+	bool Save() const;
+
+	// Fill entry with the current size and time of source, false when it cannot be read.
+	static bool Describe(const std::string &source, const std::string &output, uint64_t settings, ManifestEntry &entry);
+
+	// True when the output is still on disk and was made from the same inputs.
+	bool IsUpToDate(const ManifestEntry &entry) const;
+	void Update(const ManifestEntry &entry);
+	// Delete the recorded outputs whose source file is gone from disk, files the manifest
+	// does not know are never touched. Returns the number of deleted files.
+	int Prune();
+
+private:
+	std::string mFolder;
+	std::unordered_map<std::string, ManifestEntry> mEntries; // by output name
+};
+#endif
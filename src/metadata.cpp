@@ -0,0 +1,211 @@
+#include "metadata.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+static uint16_t Read16(const uint8_t *p, bool little)
+{
+	return little ? (uint16_t)(p[0] | p[1] << 8) : (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t Read32(const uint8_t *p, bool little)
+{
+	return little ? (uint32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24)
+				  : (uint32_t)((uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+}
+
+// Orientation tag (0x0112) of IFD0 in a TIFF structured EXIF block
+static int ParseExifOrientation(const uint8_t *data, size_t size)
+{
+	if (size < 8)
+		return 1;
+	bool little = data[0] == 'I' && data[1] == 'I';
+	if (!little && !(data[0] == 'M' && data[1] == 'M'))
+		return 1;
+	if (Read16(data + 2, little) != 42)
+		return 1;
+
+	// offsets come from the file, compare them in size_t so a crafted one cannot wrap around
+	size_t ifd = Read32(data + 4, little);
+	if (ifd > size || size - ifd < 2)
+		return 1;
+	uint16_t count = Read16(data + ifd, little);
+	for (uint16_t i = 0; i < count; i++)
+	{
+		// malformed header: more entries than the block holds
+		size_t entry = ifd + 2 + (size_t)i * 12;
+		if (entry > size || size - entry < 12)
+			break;
+		if (Read16(data + entry, little) == 0x0112)
+		{
+			int value = Read16(data + entry + 8, little);
+			return value >= 1 && value <= 8 ? value : 1;
+		}
+	}
+	return 1;
+}
+
+static bool ProbeJpeg(std::ifstream &file, ImageHeader &header)
+{
+	bool found = false;
+	std::vector<uint8_t> segment;
+	while (file)
+	{
+		int c = file.get();
+		if (c != 0xFF)
+			return found;
+		int marker = file.get();
+		while (marker == 0xFF)
+			marker = file.get();
+		// start of scan or end of image: the header is over
+		if (marker == 0xDA || marker == 0xD9 || marker == EOF)
+			break;
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+			continue;
+
+		uint8_t length[2];
+		if (!file.read((char *)length, 2))
+			break;
+		size_t size = Read16(length, false);
+		if (size < 2)
+			break;
+		size -= 2;
+
+		bool isApp1 = marker == 0xE1;
+		bool isFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+		if (!isApp1 && !isFrame)
+		{
+			file.seekg(size, std::ios::cur);
+			continue;
+		}
+
+		segment.resize(size);
+		if (!file.read((char *)segment.data(), size))
+			break;
+		if (isFrame && size >= 5)
+		{
+			header.size = cv::Size(Read16(segment.data() + 3, false), Read16(segment.data() + 1, false));
+			found = true;
+		}
+		else if (isApp1 && size > 6 && memcmp(segment.data(), "Exif\0\0", 6) == 0)
+		{
+			header.orientation = ParseExifOrientation(segment.data() + 6, size - 6);
+		}
+	}
+	return found;
+}
+
+static bool ProbePng(std::ifstream &file, ImageHeader &header)
+{
+	bool found = false;
+	std::vector<uint8_t> chunk;
+	uint8_t head[8];
+	while (file.read((char *)head, 8))
+	{
+		uint32_t size = Read32(head, false);
+		// chunk lengths are limited to 2^31 - 1, anything larger is a malformed header
+		if (size > 0x7FFFFFFFu)
+			break;
+		if (memcmp(head + 4, "IDAT", 4) == 0 || memcmp(head + 4, "IEND", 4) == 0)
+			break;
+		bool isHeader = memcmp(head + 4, "IHDR", 4) == 0;
+		bool isExif = memcmp(head + 4, "eXIf", 4) == 0;
+		if (!isHeader && !isExif)
+		{
+			file.seekg((std::streamoff)size + 4, std::ios::cur); // data and CRC
+			continue;
+		}
+
+		chunk.resize(size);
+		if (!file.read((char *)chunk.data(), size))
+			break;
+		file.seekg(4, std::ios::cur);
+		if (isHeader && size >= 8)
+		{
+			header.size = cv::Size(Read32(chunk.data(), false), Read32(chunk.data() + 4, false));
+			found = true;
+		}
+		else if (isExif)
+		{
+			header.orientation = ParseExifOrientation(chunk.data(), size);
+		}
+	}
+	return found;
+}
+
+bool ProbeImageHeader(const std::string &path, ImageHeader &header)
+{
+	header = ImageHeader();
+	std::ifstream file(path, std::ios::binary);
+	uint8_t magic[8] = {};
+	if (!file.read((char *)magic, 2))
+		return false;
+
+	bool found = false;
+	if (magic[0] == 0xFF && magic[1] == 0xD8)
+	{
+		found = ProbeJpeg(file, header);
+	}
+	else if (file.read((char *)magic + 2, 6) && memcmp(magic, "\x89PNG\r\n\x1a\n", 8) == 0)
+	{
+		found = ProbePng(file, header);
+	}
+	return found && !header.size.empty();
+}
+
+cv::Matx23d OrientationMatrix(int orientation, cv::Size stored)
+{
+	double w = stored.width - 1;
+	double h = stored.height - 1;
+	switch (orientation)
+	{
+	case 2: // mirrored
+		return cv::Matx23d(-1, 0, w, 0, 1, 0);
+	case 3: // rotated 180
+		return cv::Matx23d(-1, 0, w, 0, -1, h);
+	case 4: // mirrored vertically
+		return cv::Matx23d(1, 0, 0, 0, -1, h);
+	case 5: // transposed
+		return cv::Matx23d(0, 1, 0, 1, 0, 0);
+	case 6: // needs a 90 degree clockwise turn
+		return cv::Matx23d(0, 1, 0, -1, 0, h);
+	case 7: // transversed
+		return cv::Matx23d(0, -1, w, -1, 0, h);
+	case 8: // needs a 90 degree counter clockwise turn
+		return cv::Matx23d(0, -1, w, 1, 0, 0);
+	default:
+		return cv::Matx23d(1, 0, 0, 0, 1, 0);
+	}
+}
+
+void ApplyOrientation(cv::Mat &image, int orientation)
+{
+	switch (orientation)
+	{
+	case 2:
+		cv::flip(image, image, 1);
+		break;
+	case 3:
+		cv::rotate(image, image, cv::ROTATE_180);
+		break;
+	case 4:
+		cv::flip(image, image, 0);
+		break;
+	case 5:
+		cv::transpose(image, image);
+		break;
+	case 6:
+		cv::rotate(image, image, cv::ROTATE_90_CLOCKWISE);
+		break;
+	case 7:
+		cv::transpose(image, image);
+		cv::flip(image, image, -1);
+		break;
+	case 8:
+		cv::rotate(image, image, cv::ROTATE_90_COUNTERCLOCKWISE);
+		break;
+	default:
+		break;
+	}
+}
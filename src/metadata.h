@@ -0,0 +1,33 @@
+#ifndef _METADATA_H_
+#define _METADATA_H_
+#include <string>
+#include "opencv2/core.hpp"
+
+// What can be learned from the first bytes of a file without decoding it.
+struct ImageHeader
+{
+	cv::Size size;		  // stored size, before orientation
+	int orientation = 1; // EXIF orientation, 1..8
+};
+
+// Read dimensions and EXIF orientation from a JPEG or PNG header.
+// Returns false for other formats or damaged files.
+bool ProbeImageHeader(const std::string &path, ImageHeader &header);
+
+// Orientations 5..8 swap the image axes.
+inline bool IsTransposed(int orientation)
+{
+	return orientation >= 5 && orientation <= 8;
+}
+
+inline cv::Size OrientedSize(cv::Size size, int orientation)
+{
+	return IsTransposed(orientation) ? cv::Size(size.height, size.width) : size;
+}
+
+// Maps pixel indices of the upright image to pixel indices of the stored one.
+cv::Matx23d OrientationMatrix(int orientation, cv::Size stored);
+
+// Turn a small image (thumbnails) upright in place.
+void ApplyOrientation(cv::Mat &image, int orientation);
+#endif
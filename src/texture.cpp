@@ -0,0 +1,220 @@
+#include "texture.h"
+#include <algorithm>
+#include <utility>
+
+bool HasTextureStorage()
+{
+#if defined(GL_VERSION_4_2)
+	if (GLAD_GL_VERSION_4_2)
+		return true;
+#endif
+#if defined(GL_ARB_texture_storage)
+	if (GLAD_GL_ARB_texture_storage)
+		return true;
+#endif
+	return false;
+}
+
+static GLenum BaseFormat(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_R8:
+	case GL_R16:
+		return GL_RED;
+	case GL_RGBA8:
+	case GL_RGBA16:
+		return GL_RGBA;
+	default:
+		return GL_RGB;
+	}
+}
+
+static size_t BytesPerPixel(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_R8:
+		return 1;
+	case GL_R16:
+		return 2;
+	case GL_RGB16:
+	case GL_RGBA16:
+		return 8;
+	default:
+		return 4; // drivers pad RGB8 to four bytes
+	}
+}
+
+static int MipLevels(int width, int height)
+{
+	int levels = 1;
+	for (int size = std::max(width, height); size > 1; size >>= 1)
+		levels++;
+	return levels;
+}
+
+static uint32_t AllocateStorage(int width, int height, int levels, GLenum internalFormat)
+{
+	GLuint id = 0;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+
+#if defined(GL_VERSION_4_2) || defined(GL_ARB_texture_storage)
+	if (HasTextureStorage())
+	{
+		glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+	}
+	else
+#endif
+	{
+		// Emulate immutable storage: define every level once and never respecify it
+		GLenum format = BaseFormat(internalFormat);
+		for (int level = 0; level < levels; level++)
+			glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(1, width >> level), std::max(1, height >> level), 0, format, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // This is required on WebGL for non power-of-two textures
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Same
+	return id;
+}
+
+Texture2D::Texture2D(Texture2D &&other) noexcept
+{
+	*this = std::move(other);
+}
+
+Texture2D &Texture2D::operator=(Texture2D &&other) noexcept
+{
+	if (this != &other)
+	{
+		Release();
+		mId = std::exchange(other.mId, 0);
+		mWidth = std::exchange(other.mWidth, 0);
+		mHeight = std::exchange(other.mHeight, 0);
+		mStorageWidth = std::exchange(other.mStorageWidth, 0);
+		mStorageHeight = std::exchange(other.mStorageHeight, 0);
+		mLevels = std::exchange(other.mLevels, 0);
+		mInternalFormat = std::exchange(other.mInternalFormat, 0);
+	}
+	return *this;
+}
+
+Texture2D::~Texture2D()
+{
+	Release();
+}
+
+void Texture2D::Upload(const void *data, GLenum format, GLenum type, int rowLength)
+{
+	if (!mId || !data)
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, mId);
+	// set alignment explicitly to 1
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mWidth, mHeight, format, type, data);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	if (mLevels > 1)
+		glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+void Texture2D::Release()
+{
+	if (mId)
+		TexturePool::Get().Recycle(*this);
+}
+
+bool Texture2D::Resize(int width, int height)
+{
+	if (!mId || width <= 0 || height <= 0 || width > mStorageWidth || height > mStorageHeight)
+		return false;
+	mWidth = width;
+	mHeight = height;
+	return true;
+}
+
+TexturePool &TexturePool::Get()
+{
+	static TexturePool pool;
+	return pool;
+}
+
+Texture2D TexturePool::Acquire(int width, int height, GLenum internalFormat, bool mipmapped, int granularity)
+{
+	Texture2D texture;
+	if (width <= 0 || height <= 0)
+		return texture;
+
+	if (mipmapped || granularity < 1)
+		granularity = 1;
+	int storageWidth = (width + granularity - 1) / granularity * granularity;
+	int storageHeight = (height + granularity - 1) / granularity * granularity;
+	int levels = mipmapped ? MipLevels(storageWidth, storageHeight) : 1;
+
+	texture.mWidth = width;
+	texture.mHeight = height;
+	texture.mStorageWidth = storageWidth;
+	texture.mStorageHeight = storageHeight;
+	texture.mLevels = levels;
+	texture.mInternalFormat = internalFormat;
+
+	for (auto it = mIdle.begin(); it != mIdle.end(); ++it)
+	{
+		if (it->width == storageWidth && it->height == storageHeight && it->levels == levels && it->internalFormat == internalFormat)
+		{
+			texture.mId = it->id;
+			mIdleBytes -= it->bytes;
+			mIdle.erase(it);
+			mReuseCount++;
+			return texture;
+		}
+	}
+
+	texture.mId = AllocateStorage(storageWidth, storageHeight, levels, internalFormat);
+	mAllocCount++;
+	return texture;
+}
+
+void TexturePool::Recycle(Texture2D &texture)
+{
+	size_t bytes = texture.mStorageWidth * (size_t)texture.mStorageHeight * BytesPerPixel(texture.mInternalFormat);
+	if (texture.mLevels > 1)
+		bytes = bytes * 4 / 3;
+
+	mIdle.push_front({texture.mId, texture.mStorageWidth, texture.mStorageHeight, texture.mLevels, texture.mInternalFormat, bytes});
+	mIdleBytes += bytes;
+	texture.mId = 0;
+	texture.mWidth = texture.mHeight = 0;
+	texture.mStorageWidth = texture.mStorageHeight = 0;
+	texture.mLevels = 0;
+	Trim(mBudget);
+}
+
+void TexturePool::Trim(size_t budget)
+{
+	while (mIdleBytes > budget && !mIdle.empty())
+	{
+		Entry &oldest = mIdle.back();
+		glDeleteTextures(1, &oldest.id);
+		mIdleBytes -= oldest.bytes;
+		mIdle.pop_back();
+	}
+}
+
+void TexturePool::Clear()
+{
+	Trim(0);
+}
+
+void TexturePool::SetBudget(size_t bytes)
+{
+	mBudget = bytes;
+	Trim(mBudget);
+}
@@ -0,0 +1,96 @@
+#ifndef _TEXTURE_H_
+#define _TEXTURE_H_
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <glad/gl.h>
+
+// True when immutable storage (glTexStorage*) is available in the current context.
+bool HasTextureStorage();
+
+// Move-only handle to a GL texture owned by the TexturePool.
+// Storage is immutable (glTexStorage2D when available) and may be larger than
+// the content when the texture was acquired with a bucket granularity; use
+// GetU()/GetV() as the bottom-right texture coordinate when drawing it.
+class Texture2D
+{
+public:
+	Texture2D() = default;
+	Texture2D(Texture2D &&other) noexcept;
+	Texture2D &operator=(Texture2D &&other) noexcept;
+	Texture2D(const Texture2D &) = delete;
+	Texture2D &operator=(const Texture2D &) = delete;
+	~Texture2D();
+
+	// Upload width x height pixels to level 0 and rebuild the mip chain if any.
+	// rowLength is the source stride in pixels, 0 for tightly packed rows.
+	void Upload(const void *data, GLenum format, GLenum type = GL_UNSIGNED_BYTE, int rowLength = 0);
+	// Hand the storage back to the pool.
+	void Release();
+	// Change the content size without touching the storage, false when it does not fit.
+	bool Resize(int width, int height);
+
+	uint32_t GetID() const { return mId; }
+	int GetWidth() const { return mWidth; }
+	int GetHeight() const { return mHeight; }
+	int GetStorageWidth() const { return mStorageWidth; }
+	int GetStorageHeight() const { return mStorageHeight; }
+	float GetU() const { return mStorageWidth ? mWidth / (float)mStorageWidth : 0.0f; }
+	float GetV() const { return mStorageHeight ? mHeight / (float)mStorageHeight : 0.0f; }
+	bool HasMipmaps() const { return mLevels > 1; }
+	explicit operator bool() const { return mId != 0; }
+
+private:
+	friend class TexturePool;
+	uint32_t mId = 0;
+	int mWidth = 0;
+	int mHeight = 0;
+	int mStorageWidth = 0;
+	int mStorageHeight = 0;
+	int mLevels = 0;
+	GLenum mInternalFormat = 0;
+};
+
+// Recycles texture storage by size/format bucket so that resizing the preview
+// or reloading thumbnails does not allocate new driver objects every time.
+// Idle textures are kept in LRU order up to a byte budget.
+class TexturePool
+{
+public:
+	static TexturePool &Get();
+
+	// granularity rounds the storage size up so that nearby sizes share a bucket.
+	// Mipmapped textures are always allocated with the exact size.
+	Texture2D Acquire(int width, int height, GLenum internalFormat = GL_RGB8, bool mipmapped = false, int granularity = 1);
+	// Delete every idle texture. Must be called while the GL context is current.
+	void Clear();
+	void SetBudget(size_t bytes);
+
+	size_t GetIdleBytes() const { return mIdleBytes; }
+	size_t GetIdleCount() const { return mIdle.size(); }
+	size_t GetReuseCount() const { return mReuseCount; }
+	size_t GetAllocCount() const { return mAllocCount; }
+
+private:
+	friend class Texture2D;
+	struct Entry
+	{
+		uint32_t id;
+		int width;
+		int height;
+		int levels;
+		GLenum internalFormat;
+		size_t bytes;
+	};
+
+	TexturePool() = default;
+	void Recycle(Texture2D &texture);
+	void Trim(size_t budget);
+
+	std::list<Entry> mIdle; // most recently released first
+	size_t mIdleBytes = 0;
+	size_t mBudget = 256u << 20;
+	size_t mReuseCount = 0;
+	size_t mAllocCount = 0;
+};
+#endif
@@ -0,0 +1,37 @@
+#include "tiles.h"
+
+const Texture2D *TileCache::Find(int level, int x, int y)
+{
+	auto it = mIndex.find(MakeKey(level, x, y));
+	if (it == mIndex.end())
+		return nullptr;
+	mTiles.splice(mTiles.begin(), mTiles, it->second);
+	return &it->second->texture;
+}
+
+const Texture2D *TileCache::Insert(int level, int x, int y, Texture2D &&texture)
+{
+	uint64_t key = MakeKey(level, x, y);
+	auto it = mIndex.find(key);
+	if (it != mIndex.end())
+	{
+		mTiles.erase(it->second);
+		mIndex.erase(it);
+	}
+
+	while (!mTiles.empty() && mTiles.size() >= mCapacity)
+	{
+		mIndex.erase(mTiles.back().key);
+		mTiles.pop_back();
+	}
+
+	mTiles.push_front({key, std::move(texture)});
+	mIndex[key] = mTiles.begin();
+	return &mTiles.front().texture;
+}
+
+void TileCache::Clear()
+{
+	mIndex.clear();
+	mTiles.clear();
+}
@@ -0,0 +1,42 @@
+#ifndef _TILES_H_
+#define _TILES_H_
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include "texture.h"
+
+// LRU of GPU tiles of a multi-resolution frame pyramid.
+// Level 0 is the print resolution, every next level halves it.
+class TileCache
+{
+public:
+	static const int kTileSize = 256;
+
+	explicit TileCache(size_t capacity = 256) : mCapacity(capacity) {}
+
+	// Returns nullptr when the tile has not been generated yet.
+	const Texture2D *Find(int level, int x, int y);
+	const Texture2D *Insert(int level, int x, int y, Texture2D &&texture);
+	// Drop every tile, the textures go back to the pool.
+	void Clear();
+
+	size_t GetSize() const { return mTiles.size(); }
+	size_t GetCapacity() const { return mCapacity; }
+
+private:
+	struct Tile
+	{
+		uint64_t key;
+		Texture2D texture;
+	};
+
+	static uint64_t MakeKey(int level, int x, int y)
+	{
+		return ((uint64_t)level << 48) | ((uint64_t)(uint32_t)y << 24) | (uint64_t)(uint32_t)x;
+	}
+
+	size_t mCapacity;
+	std::list<Tile> mTiles; // most recently used first
+	std::unordered_map<uint64_t, std::list<Tile>::iterator> mIndex;
+};
+#endif
@@ -6,27 +6,43 @@
 #include <glad/gl.h>
 #include "opencv2/core.hpp"
 #include "opencv2/imgproc.hpp"
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <vector>
 
-#define PPI 300
+#define DEFAULT_PPI 300
 #define CM2INCH 1 / 2.54
 
-float cm2pixel(float d)
+inline float cm2pixel(float d, float ppi = DEFAULT_PPI)
 {
-	return d * PPI * CM2INCH;
+	return d * ppi * CM2INCH;
 }
 
-cv::Scalar vec2scalar(ImVec4 vec)
+inline cv::Scalar vec2scalar(ImVec4 vec)
 {
 	return cv::Scalar(vec.z * 255, vec.y * 255, vec.x * 255);
 }
 
-bool RoiRefine(cv::Rect &roi, cv::Size size)
+// Extension in any letter case, cameras write .JPG and scanners .TIF
+inline bool IsImageFile(const std::string &file_path)
+{
+	static const std::vector<std::string> extensions = { ".jpg", ".jpeg", ".png", ".tif", ".tiff" };
+	size_t dot = file_path.find_last_of('.');
+	if (dot == std::string::npos)
+		return false;
+	std::string ext = file_path.substr(dot);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return std::find(extensions.begin(), extensions.end(), ext) != extensions.end();
+}
+
+inline bool RoiRefine(cv::Rect &roi, cv::Size size)
 {
 	roi = roi & cv::Rect(cv::Point(0, 0), size);
 	return roi.area() > 0;
 }
 
-ImVec2 GetScaleImageSize(ImVec2 img_size, ImVec2 window_size)
+inline ImVec2 GetScaleImageSize(ImVec2 img_size, ImVec2 window_size)
 {
 	ImVec2 outSize{};
 	if (img_size.x != 0 && img_size.y != 0)
@@ -50,29 +66,4 @@ ImVec2 GetScaleImageSize(ImVec2 img_size, ImVec2 window_size)
 	}
 	return outSize;
 }
-
-cv::Mat resizeKeepAspectRatio(const cv::Mat &input, const cv::Size &dstSize, const cv::Scalar &bgcolor)
-{
-	cv::Mat output;
-
-	double h1 = dstSize.width * (input.rows / (double)input.cols);
-	double w2 = dstSize.height * (input.cols / (double)input.rows);
-	if (h1 <= dstSize.height)
-	{
-		cv::resize(input, output, cv::Size(dstSize.width, h1), 0, 0, cv::INTER_CUBIC);
-	}
-	else
-	{
-		cv::resize(input, output, cv::Size(w2, dstSize.height), 0, 0, cv::INTER_CUBIC);
-	}
-
-	int top = (dstSize.height - output.rows) / 2;
-	int down = (dstSize.height - output.rows + 1) / 2;
-	int left = (dstSize.width - output.cols) / 2;
-	int right = (dstSize.width - output.cols + 1) / 2;
-
-	cv::copyMakeBorder(output, output, top, down, left, right, cv::BORDER_CONSTANT, bgcolor);
-
-	return std::move(output);
-}
 #endif
\ No newline at end of file
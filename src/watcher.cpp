@@ -0,0 +1,186 @@
+#include "watcher.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FolderWatcher::~FolderWatcher()
+{
+	Close();
+}
+
+bool FolderWatcher::Open(const std::string &folder, bool reportExisting)
+{
+	Close();
+#ifdef __linux__
+	mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mFd < 0)
+		return false;
+	uint32_t mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+	if (inotify_add_watch(mFd, folder.c_str(), mask) < 0)
+	{
+		close(mFd);
+		mFd = -1;
+		return false;
+	}
+#endif
+	mFolder = folder;
+	// baseline snapshot, the files it records wait for settle like any write in progress
+	Scan();
+	if (!reportExisting)
+		mPending.clear();
+#ifndef __linux__
+	mLastScan = Clock::now();
+#endif
+	return true;
+}
+
+void FolderWatcher::Close()
+{
+#ifdef __linux__
+	if (mFd >= 0)
+		close(mFd);
+	mFd = -1;
+#endif
+	mSnapshot.clear();
+	mPending.clear();
+	mFolder.clear();
+}
+
+void FolderWatcher::Record(const std::string &name, Change change, bool closed)
+{
+	auto now = Clock::now();
+	auto it = mPending.find(name);
+	if (it == mPending.end())
+	{
+		mPending.emplace(name, Pending{change, now, now, closed});
+		return;
+	}
+
+	// a new file stays new however many times it is written before being reported
+	if (!(change == Change::Modified && it->second.change == Change::Added))
+		it->second.change = change;
+	it->second.last = now;
+	it->second.closed = closed;
+}
+
+void FolderWatcher::ReadEvents()
+{
+#ifdef __linux__
+	alignas(inotify_event) char buffer[16 * 1024];
+	bool overflow = false;
+	for (;;)
+	{
+		ssize_t length = read(mFd, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+		for (char *p = buffer; p < buffer + length;)
+		{
+			const inotify_event *event = (const inotify_event *)p;
+			p += sizeof(inotify_event) + event->len;
+			// the kernel dropped events, only a rescan tells what changed
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				overflow = true;
+				continue;
+			}
+			if (!event->len || (event->mask & IN_ISDIR))
+				continue;
+
+			std::string name(event->name);
+			if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+				Record(name, Change::Removed, false);
+			else if (event->mask & IN_MOVED_TO)
+				Record(name, Change::Added, true); // renamed into the folder, already complete
+			else if (event->mask & IN_CLOSE_WRITE)
+				Record(name, Change::Modified, true);
+			else if (event->mask & IN_CREATE)
+				Record(name, Change::Added, false);
+			else if (event->mask & IN_MODIFY)
+				Record(name, Change::Modified, false);
+		}
+	}
+	if (overflow)
+		Scan();
+#endif
+}
+
+void FolderWatcher::Scan()
+{
+	std::unordered_map<std::string, FileState> snapshot;
+	std::error_code error;
+	for (const auto &entry : std::filesystem::directory_iterator(mFolder, error))
+	{
+		if (!entry.is_regular_file(error))
+			continue;
+		std::string name = entry.path().filename().string();
+		FileState state{entry.file_size(error), entry.last_write_time(error)};
+		auto it = mSnapshot.find(name);
+		if (it == mSnapshot.end())
+			Record(name, Change::Added, false);
+		else if (it->second.size != state.size || it->second.time != state.time)
+			Record(name, Change::Modified, false);
+		snapshot.emplace(name, state);
+	}
+	for (const auto &[name, state] : mSnapshot)
+	{
+		if (!snapshot.count(name))
+			Record(name, Change::Removed, false);
+	}
+	mSnapshot = std::move(snapshot);
+}
+
+void FolderWatcher::UpdateSnapshot(const std::string &name, Change change)
+{
+	if (change == Change::Removed)
+	{
+		mSnapshot.erase(name);
+		return;
+	}
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::path(mFolder) / name;
+	FileState state{std::filesystem::file_size(path, error), std::filesystem::last_write_time(path, error)};
+	if (error)
+		mSnapshot.erase(name);
+	else
+		mSnapshot[name] = state;
+}
+
+std::vector<FolderWatcher::Event> FolderWatcher::Poll(std::chrono::milliseconds settle, std::chrono::milliseconds closeSettle)
+{
+	std::vector<Event> events;
+	if (!IsOpen())
+		return events;
+
+#ifdef __linux__
+	ReadEvents();
+	auto now = Clock::now();
+#else
+	auto now = Clock::now();
+	// without close notifications a file is complete once its size and time stop changing between scans
+	if (now - mLastScan >= settle)
+	{
+		Scan();
+		mLastScan = now;
+	}
+#endif
+
+	for (auto it = mPending.begin(); it != mPending.end();)
+	{
+		auto wait = it->second.closed ? closeSettle : settle;
+		if (now - it->second.last >= wait)
+		{
+			events.push_back({it->second.change, (std::filesystem::path(mFolder) / it->first).string(), it->second.first});
+#ifdef __linux__
+			// scans keep their own snapshot, inotify reports keep it for the overflow rescan
+			UpdateSnapshot(it->first, it->second.change);
+#endif
+			it = mPending.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	return events;
+}
@@ -0,0 +1,83 @@
+#ifndef _WATCHER_H_
+#define _WATCHER_H_
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Watches the files of one folder (not recursive).
+// Uses inotify on Linux and falls back to periodic directory scans elsewhere.
+// When the inotify queue overflows the folder is rescanned and diffed instead.
+// Bursts of events on the same file are coalesced and only reported once the
+// file has been quiet for a while, so a camera writing a JPEG in many chunks
+// produces a single event.
+class FolderWatcher
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	enum class Change
+	{
+		Added,
+		Modified,
+		Removed
+	};
+
+	struct Event
+	{
+		Change change;
+		std::string path;
+		Clock::time_point seen; // first notification of the burst
+	};
+
+	FolderWatcher() = default;
+	FolderWatcher(const FolderWatcher &) = delete;
+	FolderWatcher &operator=(const FolderWatcher &) = delete;
+	~FolderWatcher();
+
+	// Files already in the folder are only reported when reportExisting is set,
+	// as additions once they have been quiet for settle.
+	bool Open(const std::string &folder, bool reportExisting = false);
+	void Close();
+	bool IsOpen() const { return !mFolder.empty(); }
+	const std::string &GetFolder() const { return mFolder; }
+
+	// Non-blocking. settle is the quiet time required before a change is
+	// reported; files closed after writing (close-write, rename into the
+	// folder) only wait closeSettle.
+	std::vector<Event> Poll(std::chrono::milliseconds settle = std::chrono::milliseconds(300),
+							std::chrono::milliseconds closeSettle = std::chrono::milliseconds(0));
+
+private:
+	struct Pending
+	{
+		Change change;
+		Clock::time_point first;
+		Clock::time_point last;
+		bool closed;
+	};
+
+	void Record(const std::string &name, Change change, bool closed);
+	void ReadEvents();
+	// Diff the folder against mSnapshot and record the changes.
+	void Scan();
+	void UpdateSnapshot(const std::string &name, Change change);
+
+	std::string mFolder;
+	std::unordered_map<std::string, Pending> mPending; // by file name
+	struct FileState
+	{
+		uintmax_t size;
+		std::filesystem::file_time_type time;
+	};
+	// files as last reported, the baseline of a rescan
+	std::unordered_map<std::string, FileState> mSnapshot;
+#ifdef __linux__
+	int mFd = -1;
+#else
+	Clock::time_point mLastScan{};
+#endif
+};
+#endif
@@ -10,14 +10,18 @@ Window::Window() noexcept
     Window("Image App", 1280, 720);
 }
 
-Window::Window(const char *name, int width, int height, bool resizable) noexcept
+Window::Window(const char *name, int width, int height, bool resizable, bool headless) noexcept
     //: _context{GLFWContext::retain()},
     :_resizable{resizable}
 {
 	// Setup window
+#ifdef GLFW_PLATFORM_NULL
+	if (headless)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
 	if (!glfwInit())
 	{
-		logger("Err glfw init");
+		LOG_ERROR("Err glfw init");
 		return;
 	}
 
@@ -28,13 +32,20 @@ Window::Window(const char *name, int width, int height, bool resizable) noexcept
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_RESIZABLE, resizable);
+    if (headless) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#if defined(GLFW_PLATFORM_NULL) && defined(GLFW_OSMESA_CONTEXT_API)
+        if (glfwGetPlatform() == GLFW_PLATFORM_NULL)
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+    }
 
     // Create window with graphics context
     _handle = glfwCreateWindow(width, height, name, nullptr, nullptr);
     if (_handle == nullptr) {
         const char *error = nullptr;
         glfwGetError(&error);
-        logger("Failed to create GLFW window.");
+        LOG_ERROR("Failed to create GLFW window: %s", error ? error : "unknown error");
 		exit(-1);
     }
     glfwMakeContextCurrent(_handle);
@@ -43,7 +54,7 @@ Window::Window(const char *name, int width, int height, bool resizable) noexcept
     int version = gladLoadGL(glfwGetProcAddress);
 	if (version == 0)
 	{
-		logger("Failed to initialize OpenGL context");
+		LOG_ERROR("Failed to initialize OpenGL context");
 		exit(-1);
 	}
 
@@ -54,7 +65,10 @@ Window::Window(const char *name, int width, int height, bool resizable) noexcept
 	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;       // Enable Keyboard Controls
 	io.ConfigFlags |= ImGuiConfigFlags_NoMouseCursorChange;           // Enable Docking
 	io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
-	io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;         // Enable Multi-Viewport / Platform Windows
+	if (!headless)
+		io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;     // Enable Multi-Viewport / Platform Windows
+	else
+		io.IniFilename = nullptr;                               // runs must not depend on a saved layout
 	ImGui::StyleColorsDark();
 
 	// When viewports are enabled we tweak WindowRounding/WindowBg so platform windows can look identical to regular ones.
@@ -264,6 +278,6 @@ void Window::set_size(int _width, int _height) noexcept {
     if (_resizable) {
         glfwSetWindowSize(_handle, static_cast<int>(_width), static_cast<int>(_height));
     } else {
-        logger("Ignoring resize on non-resizable window.");
+        LOG_WARN("Ignoring resize on non-resizable window.");
     }
 }
\ No newline at end of file
@@ -18,7 +18,9 @@ public:
     using ScrollCallback = std::function<void(int /* dx */, int /* dy */)>;
 public:
     Window() noexcept;
-    Window(const char *name, int width, int height, bool resizable = false) noexcept;
+    // headless: hidden window without platform viewports, on the null platform with an
+    // OSMesa software context when GLFW provides them (benchmarks, machines without a display)
+    Window(const char *name, int width, int height, bool resizable = false, bool headless = false) noexcept;
     Window(Window &&) noexcept = delete;
     Window(const Window &) noexcept = delete;
     Window &operator=(Window &&) noexcept = delete;